@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+import os, subprocess, sys, re, tempfile
+
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+HASTE = os.path.join(PROJECT_DIR, "haste")
+OUTPUT = os.path.join(PROJECT_DIR, "bench_output.txt")
+RUNS = 5
+
+UNITS = {"ns": 1e-6, "µs": 1e-3, "ms": 1.0, "s": 1e3}
+
+
+def green(s):
+    print(f"\033[32m{s}\033[0m")
+
+
+def red(s):
+    print(f"\033[31m{s}\033[0m")
+
+
+# ── Workloads ───────────────────────────────────────────────────
+# each one returns the source of a file that is mostly comptime folding
+
+def chain(n):
+    # every constant depends on the one before it
+    lines = ["const c0 = 1;"]
+    for i in range(1, n):
+        lines.append(f"const c{i} = (c{i - 1} + {i}) / 2 + {i} * 3 - (c{i - 1} - {i}) / 7;")
+    return "\n".join(lines) + "\n"
+
+
+def wide(n, terms):
+    # few constants with huge initializers
+    lines = []
+    for i in range(n):
+        expr = " + ".join(f"({j} * {i + 1} - {j} / 3)" for j in range(1, terms))
+        lines.append(f"const w{i} = {expr};")
+    return "\n".join(lines) + "\n"
+
+
+def floats(n):
+    lines = ["const f0: float = 1.5;"]
+    for i in range(1, n):
+        lines.append(f"const f{i} = f{i - 1} * 0.5 + cast[float] {i} / 3.0 - -{i}.25;")
+    return "\n".join(lines) + "\n"
+
+
+WORKLOADS = [
+    ("chain",  chain(20000)),
+    ("wide",   wide(50, 400)),
+    ("floats", floats(20000)),
+]
+# ────────────────────────────────────────────────────────────────
+
+
+def analysis_ms(path, flags):
+    cmd = [HASTE, "--measure", "--no-fun", *flags, path]
+    result = subprocess.run(cmd, capture_output=True, cwd=PROJECT_DIR)
+    if result.returncode != 0:
+        red(result.stderr.decode(errors="replace"))
+        sys.exit(1)
+    m = re.search(r"analysis\s+took\s+([\d.]+)\s+(\S+)", result.stderr.decode())
+    if not m:
+        red("could not find the analysis timing in the output")
+        sys.exit(1)
+    return float(m.group(1)) * UNITS[m.group(2)]
+
+
+def best_of(path, flags):
+    return min(analysis_ms(path, flags) for _ in range(RUNS))
+
+
+def main():
+    if not os.path.exists(HASTE):
+        red(f"{HASTE} not found. run `make` first.")
+        sys.exit(1)
+
+    rows = []
+    with tempfile.TemporaryDirectory() as tmp:
+        for name, source in WORKLOADS:
+            path = os.path.join(tmp, f"{name}.haste")
+            with open(path, "w") as f:
+                f.write(source)
+            tree = best_of(path, ["--no-comptime-vm"])
+            vm = best_of(path, [])
+            rows.append((name, tree, vm))
+
+    lines = [
+        f"comptime evaluation (analysis phase, best of {RUNS})",
+        f"{'workload':<10} {'tree walker':>14} {'bytecode vm':>14} {'speedup':>9}",
+    ]
+    for name, tree, vm in rows:
+        lines.append(f"{name:<10} {tree:>11.2f} ms {vm:>11.2f} ms {tree / vm:>8.2f}x")
+
+    with open(OUTPUT, "w") as f:
+        f.write("\n".join(lines) + "\n")
+    for line in lines:
+        print(line)
+    green(f"written to {os.path.relpath(OUTPUT, PROJECT_DIR)}")
+
+
+if __name__ == "__main__":
+    main()
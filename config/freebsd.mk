@@ -6,7 +6,7 @@ STD := $(shell echo 'int main(){}' | $(CC) -std=c23 -x c - -o /dev/null 2>/dev/n
 LLVM_CONFIG ?= $(shell command -v llvm-config 2>/dev/null)
 ifneq ($(LLVM_CONFIG),)
   CFLAGS   := -std=$(STD) -Iinclude/ $(shell $(LLVM_CONFIG) --cflags)
-  LDFLAGS  := $(shell $(LLVM_CONFIG) --ldflags) -lstdc++ $(shell $(LLVM_CONFIG) --libs core)
+  LDFLAGS  := $(shell $(LLVM_CONFIG) --ldflags) -lstdc++ $(shell $(LLVM_CONFIG) --libs core native passes analysis bitreader bitwriter linker orcjit)
 else
   CFLAGS   := -std=$(STD) -Iinclude/
   LDFLAGS  := -lLLVM
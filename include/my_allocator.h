@@ -29,7 +29,8 @@ union max_align_t_ {
 	long double ld;
 };
 
-extern size_t allocated;
+// bumped by allocators on any thread
+extern _Atomic size_t allocated;
 
 #define MY_DEFAULT_ALIGNMENT \
 	(sizeof(union max_align_t_))
@@ -83,7 +84,7 @@ char *clone_string(struct Allocator allocator, const char *str);
 char *nclone_string(struct Allocator allocator, const char *str, const size_t len);
 
 #ifdef MY_ALLOCATOR_IMPL
-size_t allocated = 0;
+_Atomic size_t allocated = 0;
 struct Allocator default_allocator_ = {0};
 
 void set_default_allocator(struct Allocator allocator)
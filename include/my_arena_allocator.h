@@ -35,6 +35,8 @@ struct Arena {
 struct Arena Arena(struct Allocator child_allocator);
 struct Arena ArenaDefault(void);
 void arena_free(struct Arena *self);
+void arena_reset(struct Arena *self);
+int arena_owns(struct Arena *self, const void *ptr);
 void arena_print(FILE *out, const struct Arena arena);
 
 struct Allocator arena_get_allocator(struct Arena *arena);
@@ -75,13 +77,31 @@ void arena_free(struct Arena *self)
 	*self = (struct Arena){0};
 }
 
+// Keeps the blocks and starts allocating from the first one again
+void arena_reset(struct Arena *self)
+{
+	for (struct ArenaBlock *current = self->begin; current != NULL; current = current->next) {
+		current->current = current + 1;
+	}
+	self->end = self->begin;
+}
+
 struct Allocator arena_get_allocator(struct Arena *arena)
 {
 	return Allocator(arena, &vtable);
 }
 
+static size_t block_actual_size(const struct ArenaBlock *self);
+
 static struct ArenaBlock *arena_append_block(struct Arena *self, size_t min_size)
 {
+	// blocks left over from before an `arena_reset` are used first
+	if (self->end != NULL && self->end->next != NULL
+	    && block_actual_size(self->end->next) >= min_size) {
+		self->end = self->end->next;
+		return self->end;
+	}
+
 	size_t block_size = (ARENA_REGION_DEFAULT_CAPACITY > min_size ? ARENA_REGION_DEFAULT_CAPACITY : min_size) + sizeof(struct ArenaBlock);
 	// if (min_size + sizeof(struct ArenaBlock) > block_size) {
 	// 	block_size = min_size + sizeof(struct ArenaBlock);
@@ -105,6 +125,7 @@ static struct ArenaBlock *arena_append_block(struct Arena *self, size_t min_size
 		self->begin = new_block;
 		self->end = new_block;
 	} else {
+		new_block->next = self->end->next;
 		self->end->next = new_block;
 		self->end = new_block;
 	}
@@ -143,6 +164,11 @@ static struct ArenaBlock *find_owner(struct Arena *self, void *ptr)
 	return NULL;
 }
 
+int arena_owns(struct Arena *self, const void *ptr)
+{
+	return find_owner(self, (void*)ptr) != NULL;
+}
+
 static void *arena_allocate_virt(void *data, size_t alignment, size_t size)
 {
     struct Arena *self = data;
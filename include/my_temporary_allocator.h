@@ -44,7 +44,9 @@ char *tsprintf(const char *fmt, ...);
 # include <threads.h>
 
 # define TEMPORARY_ALLOCATOR_DEFAULT_CAP 8192
-# define is_using_heap() (global_temporary.buffer != global_temporary_buffer)
+# define is_using_heap() (global_temporary.buffer != NULL)
+// NULL `buffer` means the default one. it is per thread, like the allocator
+# define temporary_buffer(self_) ((self_)->buffer ? (self_)->buffer : global_temporary_buffer)
 
 struct temporary_allocator {
 	size_t used;
@@ -52,11 +54,11 @@ struct temporary_allocator {
 	unsigned char *buffer;
 };
 
-static unsigned char global_temporary_buffer[TEMPORARY_ALLOCATOR_DEFAULT_CAP] = {0};
+thread_local static unsigned char global_temporary_buffer[TEMPORARY_ALLOCATOR_DEFAULT_CAP] = {0};
 thread_local static struct temporary_allocator global_temporary = {
 	.cap = TEMPORARY_ALLOCATOR_DEFAULT_CAP,
 	.used = 0,
-	.buffer = global_temporary_buffer,
+	.buffer = NULL,
 };
 
 static void *temp_allocate_virt(void *self, size_t alignment, size_t size);
@@ -87,7 +89,7 @@ void free_temporary_allocator(void)
 
 	global_temporary.cap = TEMPORARY_ALLOCATOR_DEFAULT_CAP;
 	global_temporary.used = 0;
-	global_temporary.buffer = global_temporary_buffer;
+	global_temporary.buffer = NULL;
 }
 
 void reset_temporary_allocator(void)
@@ -149,7 +151,7 @@ static void *temp_allocate_virt(void *data, size_t alignment, size_t size)
 {
 	struct temporary_allocator *const self = data;
 
-	uintptr_t curr = (uintptr_t)(self->buffer + self->used);
+	uintptr_t curr = (uintptr_t)(temporary_buffer(self) + self->used);
 	uintptr_t aligned = (curr + alignment - 1) & ~(alignment - 1);
 	size_t padding = aligned - curr;
 
@@ -175,7 +177,7 @@ static void *temp_reallocate_virt(void *data, size_t old_size, void *ptr, size_t
 	(void)old_size;
 	struct temporary_allocator *const self = data;
 
-	const size_t potential_allocation_size = (uintptr_t)(self->buffer + self->used) - (uintptr_t)ptr;
+	const size_t potential_allocation_size = (uintptr_t)(temporary_buffer(self) + self->used) - (uintptr_t)ptr;
 	void* const result = temp_allocate_virt(self, alignment, new_size);
 	memcpy(result, ptr, MIN(potential_allocation_size, new_size));
 
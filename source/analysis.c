@@ -2,7 +2,6 @@
 #include "my_allocator.h"
 #include "my_common.h"
 #include "my_stream.h"
-#include "my_termcolor.h"
 #include <stdio.h>
 
 // symbols has three levels
@@ -26,10 +25,14 @@ struct scope {
 		const char *key;
 		bool is_constant : 1;
 		bool is_explicitly_comptime : 1;
+		bool on_path : 1; // see analyze_dependencies_first()
+		bool is_global : 1;
+		uint32_t slot; // copied to the identifiers that resolve to it
 		enum symbol_level level;
 		struct haste_type type;
 		struct haste_value value;
 		struct haste_ast_node *node;
+		uint64_t fingerprint;
 	} *items;
 };
 
@@ -38,13 +41,61 @@ struct symbol_set {
 	struct symbol *items;
 };
 
+// the declarations resolved while analyzing a top-level declaration
+struct decl_trace {
+	struct symbol *symbol;
+	struct analysis_cache_deps deps;
+};
+
 struct analyzer {
 	struct Allocator allocator;
 	struct Allocator arena_allocator;
+	// where comptime objects (strings, structs) are created. the scratch
+	// arena while a constant is evaluated, `allocator` otherwise
+	struct Allocator comptime;
+	struct Arena scratch;
+	uint32_t scratch_users; // declarations evaluating into `scratch` right now
+	// the initializer of the variable declaration being analyzed, a type
+	// created for it takes the declaration's name. see new_type_name
+	const struct haste_ast_node *named_node;
+	const char *type_name;
+	// slots handed out so far: one per top-level declaration, and one per
+	// parameter or local of the function being analyzed
+	uint32_t global_slots, local_slots;
 	struct scope *global, *local;
 	source_file_id src;
 	bool had_error;
+	size_t error_count;
 	struct haste_type current_return_type;
+	struct analysis_cache *cache; // NULL when not incremental
+	struct declaration_sink sink; // `done` is NULL when not streaming
+	struct decl_trace *trace;
+	struct vm vm;
+	// functions whose bodies are being analyzed. the VM can't compile them yet
+	struct { size_t cap, len; const struct haste_ast_func_decl **items; } open_functions;
+	// analyzing a function body, not a global it needs. see fold_func_call()
+	bool in_function_body;
+
+	// comptime budgets. both allocators count into `bytes`, steps live in the VM
+	struct counting_allocator { struct Allocator inner; uint64_t *bytes; } counted, counted_arena, counted_scratch;
+	struct Allocator file_arena; // what `counted_arena` wraps outside a declaration's own tree arena
+	uint64_t bytes;
+	struct budget_scope *budget; // the declaration being analyzed. NULL at top level
+	uint64_t start_ns;
+	uint64_t byte_limit;
+	bool total_budget_reported;
+};
+
+// one per declaration being analyzed. a declaration's budget only counts
+// its own work: what nested declarations use is taken off when they finish
+struct budget_scope {
+	struct budget_scope *outer;
+	struct symbol *symbol;
+	uint64_t steps, bytes, ns; // the counters when this declaration's work started
+	// the counters on entry. `steps` and co move past nested declarations,
+	// these don't, so the outer scope is let off their work too
+	uint64_t entry_steps, entry_bytes, entry_ns;
+	bool reported;
 };
 
 /* 🗣️: Stop using macros they are bad
@@ -81,33 +132,30 @@ struct analyzer {
 #define IS_AUTO(type) \
 	type_equal(type, ty_auto)
 
-#define fail_var_decl(symbol_, node_) \
-	do { \
-		reset_new_type_counter(); \
-		emit_error_symbol(symbol_, node_); \
-	} while (0)
-
 static struct haste_value analyze_node(struct analyzer *self, struct haste_ast_node *node, struct haste_type expected_type);
 
 // ── Error helpers ────────────────────────────────────────────────
 
-static void _vreport(struct analyzer *self, struct location location, const char *kind, bool set_error, const char *restrict fmt, va_list args)
+static void _vreport(struct analyzer *self, struct location location, enum diagnostic_severity severity, bool set_error, const char *restrict fmt, va_list args)
 {
-	f_vreport_at_location(kind, location, fmt, args);
-	if (set_error) self->had_error = true;
+	f_vreport_at_location(severity, location, fmt, args);
+	if (set_error) {
+		self->had_error = true;
+		self->error_count += 1;
+	}
 }
 
-#define DEFINE_REPORT_FN(name, color, label, set_error) \
+#define DEFINE_REPORT_FN(name, severity, set_error) \
 	static void _report_##name##_node(struct analyzer *self, struct haste_ast_node *node, const char *restrict fmt, ...) \
-	{ va_list args; va_start(args, fmt); _vreport(self, node->location, color label, set_error, fmt, args); va_end(args); } \
+	{ va_list args; va_start(args, fmt); _vreport(self, node->location, severity, set_error, fmt, args); va_end(args); } \
 	static void _report_##name##_token(struct analyzer *self, struct token token, const char *restrict fmt, ...) \
-	{ va_list args; va_start(args, fmt); _vreport(self, as_location(token), color label, set_error, fmt, args); va_end(args); } \
+	{ va_list args; va_start(args, fmt); _vreport(self, as_location(token), severity, set_error, fmt, args); va_end(args); } \
 	static void _report_##name##_location(struct analyzer *self, struct location loc, const char *restrict fmt, ...) \
-	{ va_list args; va_start(args, fmt); _vreport(self, loc, color label, set_error, fmt, args); va_end(args); }
+	{ va_list args; va_start(args, fmt); _vreport(self, loc, severity, set_error, fmt, args); va_end(args); }
 
-DEFINE_REPORT_FN(error,   ANSI_CODE_RED,    "Error",   true)
-DEFINE_REPORT_FN(note,    ANSI_CODE_GREEN,  "Note",   false)
-DEFINE_REPORT_FN(warning, ANSI_CODE_YELLOW, "Warning", false)
+DEFINE_REPORT_FN(error,   DIAG_ERROR,   true)
+DEFINE_REPORT_FN(note,    DIAG_NOTE,    false)
+DEFINE_REPORT_FN(warning, DIAG_WARNING, false)
 
 #define report_error(self_, node_, ...) \
 	_Generic((node_), \
@@ -173,23 +221,50 @@ static bool _put_symbol(struct analyzer *self, struct scope *scope, const char *
 
 static struct symbol _recursion_sentinel = { .value = VAL_BAD };
 
+static struct haste_value analyze_declaration(struct analyzer *self, struct symbol *symbol);
+static struct haste_value keep_value(struct analyzer *self, struct haste_value value);
+static struct haste_value keep_type_value(struct analyzer *self, struct haste_value value);
+static struct Allocator type_allocator(struct analyzer *self);
+
+static void record_dependency(struct analyzer *self, struct symbol *s)
+{
+	struct decl_trace *trace = self->trace;
+	if (trace == NULL or trace->symbol == s) return;
+
+	iarreach (i, trace->deps) {
+		if (trace->deps.items[i].name == s->key) return;
+	}
+	arrpush(self->cache->allocator, trace->deps, ((struct analysis_cache_dep){
+		.name = s->key,
+		.fingerprint = s->fingerprint,
+	}));
+}
+
+static struct symbol *resolve_symbol(struct analyzer *self, struct scope *scope, struct symbol *s)
+{
+	if (s->level == SYM_DEFINED) {
+		report_error(
+			self, s->node,
+			"Recursive declaration is not allowed");
+		return &_recursion_sentinel;
+	}
+
+	if (s->level == SYM_UNDEFINED) {
+		discard analyze_declaration(self, s);
+	}
+
+	if (scope == self->global) {
+		record_dependency(self, s);
+	}
+	return s;
+}
+
 static struct symbol *find_local_first(struct analyzer *self, const char *name)
 {
 	leach (struct scope, scope, self->local) {
 		struct symbol *s = hmget(*scope, name);
 		if (s == NULL) continue;
-		if (s->level == SYM_DEFINED) {
-			report_error(
-				self, s->node,
-				"Recursive declaration is not allowed");
-			return &_recursion_sentinel;
-		}
-
-		if (s->level == SYM_UNDEFINED) {
-			discard analyze_node(self, s->node, (struct haste_type){0});
-			return s;
-		}
-		return s;
+		return resolve_symbol(self, scope, s);
 	}
 
 	return NULL;
@@ -197,11 +272,6 @@ static struct symbol *find_local_first(struct analyzer *self, const char *name)
 
 // ── Struct helpers ─────────────────────────────────────────────
 
-static bool field_name_matches(struct haste_struct_field field, const char *name)
-{
-	return strcmp(name, field.name) == 0;
-}
-
 static void inject_struct_type(struct analyzer *self, struct haste_ast_node *node, struct haste_type field_type)
 {
 	if (node->kind != ND_STRUCT_LITERAL) return;
@@ -217,17 +287,6 @@ static void inject_struct_type(struct analyzer *self, struct haste_ast_node *nod
 	lit->type_expr = ty_node;
 }
 
-// TODO: gotta refactor this one
-static ssize_t find_struct_field(struct haste_struct_type_info *st, const char *name)
-{
-	iarreach (i, *st) {
-		if (field_name_matches(st->items[i], name)) {
-			return i;
-		}
-	}
-	return -1;
-}
-
 // Returns true on error. Fills `*out` with the field info on success.
 static bool read_struct_field(struct analyzer *self,
 							  const char *name,
@@ -256,7 +315,7 @@ static bool read_struct_field(struct analyzer *self,
 		if (not IS_AUTO(field_type)) {
 			struct haste_type default_value_type = typeof_value(default_value);
 			if (not type_equal(field_type, default_value_type)) {
-				struct haste_value result = value_coerce(self->allocator, field_type, default_value);
+				struct haste_value result = value_coerce(self->comptime, field_type, default_value);
 				if (IS_BAD(result)) {
 					report_error(self, field->default_value,
 								 "Cannot set the default value of type '{value}' to '{value}'",
@@ -284,7 +343,7 @@ static bool read_struct_field(struct analyzer *self,
 	*out = (struct haste_struct_field){
 		.name = name,
 		.type = field_type,
-		.default_value = default_value,
+		.default_value = keep_type_value(self, default_value), // outlives the declaration
 		.has_default = has_default,
 	};
 	return false;
@@ -324,64 +383,437 @@ static struct haste_value analyze_binary(struct analyzer *self, struct haste_ast
 	return VAL_NONE;
 }
 
-#define BINARY_OP_CASE(kind, op_func, op_name) \
-	case kind: { \
-		catch(value, err, op_func(lhs, rhs)) {  \
-			discard err; \
-			switch (err) { \
-			case ERR_INCOMPATIBLE_ARITH_TYPES: \
-				report_error(self, op_loc, \
-					op_name " is not possible between a value of type '{value}' and a value of type '{value}'", \
-					typeof_value(lhs), typeof_value(rhs)); \
-				break; \
-			case ERR_ARITH_OVERFLOW: \
-				report_error(self, op_loc, \
-					op_name " is not possible because of arithmatic overflow."); \
-				break; \
-			case ERR_DIVISION_BY_ZERO: \
-				report_error(self, op_loc, \
-					op_name " by zero is not possible."); \
-				break; \
-			default: unreachable(); \
-			} \
-			return VAL_BAD; \
-		} \
-		return value; \
-	} break
+static const char *arith_op_name(enum token_kind op_kind)
+{
+	switch (op_kind) {
+	case TK_PLUS:   return "Addition";
+	case TK_MINUS:  return "Subtraction";
+	case TK_STAR:   return "Multiplication";
+	case TK_FSLASH: return "Division";
+	default: unreachable();
+	}
+}
 
-static struct haste_value resolve_binary_op(struct analyzer *self, struct haste_value lhs, struct haste_value rhs, enum token_kind op_kind, struct location op_loc)
+// shared with the bytecode VM. so both evaluators report the same way
+static void report_arith_error(
+	struct analyzer *self,
+	enum token_kind op_kind,
+	enum haste_value_error err,
+	struct haste_type lhs_type,
+	struct haste_type rhs_type,
+	struct location op_loc)
+{
+	if (op_kind == TK_PLUS) {
+		run_at_percent (1.5) {
+			report_error(self, op_loc, "Addition is not impossible. (try harder)");
+			return;
+		}
+	}
+
+	const char *op_name = arith_op_name(op_kind);
+	switch (err) {
+	case ERR_INCOMPATIBLE_ARITH_TYPES:
+		report_error(self, op_loc,
+			"{s} is not possible between a value of type '{value}' and a value of type '{value}'",
+			op_name, lhs_type, rhs_type);
+		break;
+	case ERR_ARITH_OVERFLOW:
+		report_error(self, op_loc,
+			"{s} is not possible because of arithmatic overflow.", op_name);
+		break;
+	case ERR_DIVISION_BY_ZERO:
+		report_error(self, op_loc,
+			"{s} by zero is not possible.", op_name);
+		break;
+	default: unreachable();
+	}
+}
+
+static struct haste_value apply_binary_op(enum token_kind op_kind, struct haste_value lhs, struct haste_value rhs)
 {
 	switch (op_kind) {
-	case TK_PLUS: {
-		catch (value, err, value_add(lhs, rhs)) {
-			run_at_percent (1.5) {
-				report_error(self, op_loc, "Addition is not impossible. (try harder)");
-				return VAL_BAD;
-			}
+	case TK_PLUS:   return value_add(lhs, rhs);
+	case TK_MINUS:  return value_sub(lhs, rhs);
+	case TK_STAR:   return value_mul(lhs, rhs);
+	case TK_FSLASH: return value_div(lhs, rhs);
+	default: unreachable();
+	}
+}
 
-			switch (err) {
-			case ERR_INCOMPATIBLE_ARITH_TYPES:
-				report_error(self, op_loc,
-					"Addition is not possible between a value of type '{value}' and a value of type '{value}'",
-					typeof_value(lhs), typeof_value(rhs));
-				break;
-			case ERR_ARITH_OVERFLOW:
-				report_error(self, op_loc,
-					"Addition is not possible because of arithmatic overflow.");
-				break;
-			default: unreachable();
+static struct haste_value resolve_binary_op(struct analyzer *self, struct haste_value lhs, struct haste_value rhs, enum token_kind op_kind, struct location op_loc)
+{
+	catch (value, err, apply_binary_op(op_kind, lhs, rhs)) {
+		report_arith_error(self, op_kind, err, typeof_value(lhs), typeof_value(rhs), op_loc);
+		return VAL_BAD;
+	}
+	return value;
+}
+
+// ── Comptime VM ──────────────────────────────────────────────────
+
+static bool vm_lookup(void *ctx, const struct haste_ast_ident *ident, struct haste_value *out)
+{
+	struct analyzer *self = ctx;
+	leach (struct scope, scope, self->local) {
+		struct symbol *s = hmget(*scope, ident->value.chars);
+		if (s == NULL) continue;
+		// the tree walker reports these
+		if (s->level == SYM_DEFINED or s->level == SYM_AHH) return false;
+
+		*out = resolve_symbol(self, scope, s)->value;
+		return is_comptime_known(*out);
+	}
+	return false;
+}
+
+static bool vm_type_of(void *ctx, struct haste_ast_node *node, struct haste_type *out)
+{
+	struct analyzer *self = ctx;
+	struct haste_value value = analyze_node(self, node, (struct haste_type){0});
+	if (not IS_TYPE(value)) return false;
+	*out = into_type(value);
+	return true;
+}
+
+static const struct haste_ast_func_decl *vm_function_of(void *ctx, const struct haste_ast_node *callee, bool from_global)
+{
+	struct analyzer *self = ctx;
+	if (callee->kind != ND_IDENT) return NULL;
+
+	const char *name = ((const struct haste_ast_ident*)callee)->value.chars;
+	leach (struct scope, scope, from_global then self->global otherwise self->local) {
+		struct symbol *s = hmget(*scope, name);
+		if (s == NULL) continue;
+		if (s->node == NULL or s->node->kind != ND_FUNC_DECL) return NULL;
+		if (s->level == SYM_DEFINED or s->level == SYM_AHH) return NULL;
+
+		const struct haste_ast_func_decl *decl = (void*)resolve_symbol(self, scope, s)->node;
+		iarreach (i, self->open_functions) {
+			if (self->open_functions.items[i] == decl) return NULL;
+		}
+		return decl;
+	}
+	return NULL;
+}
+
+// ── Comptime budget ──────────────────────────────────────────────
+
+static void *counting_allocate(void *data, size_t alignment, size_t size)
+{
+	struct counting_allocator *c = data;
+	*c->bytes += size;
+	return allocator_alloc(c->inner, alignment, size);
+}
+
+static void *counting_reallocate(void *data, size_t old_size, void *ptr, size_t alignment, size_t new_size)
+{
+	struct counting_allocator *c = data;
+	if (new_size > old_size) *c->bytes += new_size - old_size;
+	return allocator_realloc(c->inner, old_size, ptr, alignment, new_size);
+}
+
+static void counting_free(void *data, size_t size, void *ptr)
+{
+	struct counting_allocator *c = data;
+	allocator_free(c->inner, size, ptr);
+}
+
+static struct AllocatorInterface counting_allocator_vtable = {
+	.allocate = counting_allocate,
+	.reallocate = counting_reallocate,
+	.free = counting_free,
+};
+
+static uint64_t min_limit(uint64_t a, uint64_t b)
+{
+	if (a == 0) return b;
+	if (b == 0) return a;
+	return a < b then a otherwise b;
+}
+
+// the absolute counter values where the current declaration (or the whole
+// analysis) runs out. 0 means no limit
+static void budget_refresh(struct analyzer *self)
+{
+	const struct comptime_budget decl = g_options.decl_budget;
+	const struct comptime_budget total = g_options.total_budget;
+	const struct budget_scope *scope = self->budget;
+
+	uint64_t steps = total.steps;
+	uint64_t bytes = total.bytes;
+	uint64_t ns = total.ms then self->start_ns + total.ms * 1000000 otherwise 0;
+	if (scope != NULL) {
+		steps = min_limit(steps, decl.steps then scope->steps + decl.steps otherwise 0);
+		bytes = min_limit(bytes, decl.bytes then scope->bytes + decl.bytes otherwise 0);
+		ns = min_limit(ns, decl.ms then scope->ns + decl.ms * 1000000 otherwise 0);
+	}
+	self->vm.step_limit = steps then steps otherwise UINT64_MAX;
+	self->vm.deadline_ns = ns;
+	self->byte_limit = bytes;
+}
+
+static void init_budget(struct analyzer *self)
+{
+	self->counted = (struct counting_allocator){ .inner = self->allocator, .bytes = &self->bytes };
+	self->counted_arena = (struct counting_allocator){ .inner = self->arena_allocator, .bytes = &self->bytes };
+	self->file_arena = self->arena_allocator;
+	self->scratch = Arena(self->counted.inner);
+	self->counted_scratch = (struct counting_allocator){ .inner = arena_get_allocator(&self->scratch), .bytes = &self->bytes };
+	self->allocator = Allocator(&self->counted, &counting_allocator_vtable);
+	self->arena_allocator = Allocator(&self->counted_arena, &counting_allocator_vtable);
+	self->comptime = self->allocator;
+	self->start_ns = vm_now_ns();
+	budget_refresh(self);
+}
+
+static void budget_enter(struct analyzer *self, struct budget_scope *scope, struct symbol *symbol)
+{
+	*scope = (struct budget_scope){
+		.outer = self->budget,
+		.symbol = symbol,
+		.steps = self->vm.steps,
+		.bytes = self->bytes,
+		.ns = vm_now_ns(),
+	};
+	scope->entry_steps = scope->steps;
+	scope->entry_bytes = scope->bytes;
+	scope->entry_ns = scope->ns;
+	self->budget = scope;
+	budget_refresh(self);
+}
+
+static void budget_leave(struct analyzer *self, struct budget_scope *scope)
+{
+	struct budget_scope *outer = scope->outer;
+	if (outer != NULL) {
+		outer->steps += self->vm.steps - scope->entry_steps;
+		outer->bytes += self->bytes - scope->entry_bytes;
+		outer->ns += vm_now_ns() - scope->entry_ns;
+	}
+	self->budget = outer;
+	budget_refresh(self);
+}
+
+// gives back what an evaluation that is thrown away used, its time
+// included: every deadline moves past it
+static void budget_refund(struct analyzer *self, uint64_t steps, uint64_t bytes, uint64_t ns)
+{
+	const uint64_t elapsed = vm_now_ns() - ns;
+	self->vm.steps = steps;
+	self->bytes = bytes;
+	self->start_ns += elapsed;
+	for (struct budget_scope *scope = self->budget; scope != NULL; scope = scope->outer) {
+		scope->ns += elapsed;
+		scope->entry_ns += elapsed;
+	}
+	budget_refresh(self);
+}
+
+static const char *budget_name(enum haste_value_error code)
+{
+	switch (code) {
+	case ERR_COMPTIME_STEPS: return "step";
+	case ERR_COMPTIME_TIME:  return "time";
+	default:                 return "memory";
+	}
+}
+
+static uint64_t budget_amount(struct comptime_budget budget, enum haste_value_error code)
+{
+	switch (code) {
+	case ERR_COMPTIME_STEPS: return budget.steps;
+	case ERR_COMPTIME_TIME:  return budget.ms;
+	default:                 return budget.bytes;
+	}
+}
+
+// reports a budget once per declaration (and once for the whole analysis),
+// with the calls and the declarations that were being evaluated
+static void report_budget_exceeded(struct analyzer *self, struct location loc, enum haste_value_error code, const struct location *trace, const uint32_t *trace_calls, uint32_t trace_len)
+{
+	struct budget_scope *scope = self->budget;
+	const struct comptime_budget decl = g_options.decl_budget;
+	const struct comptime_budget total = g_options.total_budget;
+
+	const uint64_t used_total = code == ERR_COMPTIME_STEPS then self->vm.steps
+		otherwise code == ERR_COMPTIME_TIME then (vm_now_ns() - self->start_ns) / 1000000
+		otherwise self->bytes;
+	const bool is_total = budget_amount(total, code) != 0 and used_total >= budget_amount(total, code);
+	const char *unit = code == ERR_COMPTIME_STEPS then "steps" otherwise code == ERR_COMPTIME_TIME then "ms" otherwise "bytes";
+
+	if (is_total) {
+		if (self->total_budget_reported) return;
+		self->total_budget_reported = true;
+		report_error(self, loc,
+			"Compile-time evaluation ran out of the {s} budget of the whole analysis ({lu} {s}). raise it with --comptime-total-{s}.",
+			budget_name(code), budget_amount(total, code), unit, unit);
+	} else if (scope != NULL) {
+		if (scope->reported) return;
+		scope->reported = true;
+		report_error(self, loc,
+			"Compile-time evaluation of '{s}' ran out of its {s} budget ({lu} {s}). raise it with --comptime-{s}.",
+			scope->symbol->key, budget_name(code), budget_amount(decl, code), unit, unit);
+	} else {
+		return;
+	}
+
+	for (uint32_t i = 0; i < trace_len; i += 1) {
+		if (trace_calls[i] == 1) {
+			report_note(self, trace[i], "Called from here.");
+		} else {
+			report_note(self, trace[i], "Called from here {lu} times.", (unsigned long)trace_calls[i]);
+		}
+	}
+	for (struct budget_scope *s = scope; s != NULL and s->outer != NULL; s = s->outer) {
+		report_note(self, s->outer->symbol->node, "'{s}' was needed by '{s}'.", s->symbol->key, s->outer->symbol->key);
+	}
+}
+
+// the tree walker's side of the budget. every analyzed node is a step
+static bool budget_check(struct analyzer *self, struct haste_ast_node *node)
+{
+	struct vm *vm = &self->vm;
+	enum haste_value_error code;
+	if (++vm->steps > vm->step_limit) {
+		code = ERR_COMPTIME_STEPS;
+	} else if (self->byte_limit != 0 and self->bytes > self->byte_limit) {
+		code = ERR_COMPTIME_BYTES;
+	} else if ((vm->steps & 0xfff) == 0 and vm->deadline_ns != 0 and vm_now_ns() > vm->deadline_ns) {
+		code = ERR_COMPTIME_TIME;
+	} else {
+		return true;
+	}
+	report_budget_exceeded(self, node->location, code, NULL, NULL, 0);
+	return false;
+}
+
+static bool budget_exhausted(const struct analyzer *self)
+{
+	return self->total_budget_reported;
+}
+
+// ── Comptime heap ────────────────────────────────────────────────
+//
+// Constants are evaluated into `scratch`, so the intermediate objects
+// (casts, copies before a write, ...) don't stay around. once the value of
+// a constant is final, the objects it still uses are copied out into
+// `allocator` and the arena is reused by the next constant. nothing outside
+// the arena ever points into it: values stored anywhere longer lived (the
+// declaration, field defaults, the shared instances of a type) are copied
+// out first.
+
+static struct haste_object *keep_object(struct analyzer *self, struct haste_type type, struct haste_object *obj)
+{
+	if (not arena_owns(&self->scratch, obj)) return obj;
+
+	switch (obj->kind) {
+	case HASTE_OBJ_STRING: {
+		struct haste_string_object *so = (void*)obj;
+		return create_string(self->allocator, so->data, so->len);
+	}
+	case HASTE_OBJ_STRUCT: {
+		struct haste_struct_object *so = (void*)obj;
+		const struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(type);
+		struct haste_struct_object *copy = alloc(self->allocator, STRUCT_OBJECT_SIZE(so->len));
+		memcpy(copy, so, STRUCT_OBJECT_SIZE(so->len));
+		for (uint32_t i = 0; i < copy->len; i += 1) {
+			struct haste_value field = struct_object_get(copy, st, i);
+			if (IS_OBJ(field)) {
+				field.obj = keep_object(self, st->items[i].type, field.obj);
+				struct_object_put(copy, st, i, field);
 			}
-			return VAL_BAD;
 		}
+		return &copy->base;
+	}
+	}
+	unreachable();
+}
+
+// Returns `value` with none of its objects in the scratch arena
+static struct haste_value keep_value(struct analyzer *self, struct haste_value value)
+{
+	if (IS_OBJ(value)) {
+		value.obj = keep_object(self, typeof_value(value), value.obj);
+	}
+	return value;
+}
+
+// Evaluates a top-level declaration. constants that end up comptime-known
+// go through the scratch arena; anything else (functions, runtime
+// initializers) keeps its objects in `allocator`.
+static struct haste_value evaluate_in_scratch(struct analyzer *self, struct symbol *symbol)
+{
+	const struct Allocator saved = self->comptime;
+	if (symbol->node->kind != ND_VAR_DECL) {
+		self->comptime = self->allocator;
+		struct haste_value value = analyze_node(self, symbol->node, (struct haste_type){0});
+		self->comptime = saved;
 		return value;
-	} break;
-	BINARY_OP_CASE(TK_MINUS,  value_sub, "Subtraction");
-	BINARY_OP_CASE(TK_STAR,   value_mul, "Multiplication");
-	BINARY_OP_CASE(TK_FSLASH, value_div, "Division");
-	default: unreachable();
 	}
 
-	return VAL_NONE;
+	self->comptime = Allocator(&self->counted_scratch, &counting_allocator_vtable);
+	self->scratch_users += 1;
+	struct haste_value value = analyze_node(self, symbol->node, (struct haste_type){0});
+	self->scratch_users -= 1;
+	self->comptime = saved;
+
+	struct haste_ast_var_decl *decl = (void*)symbol->node;
+	if (IS_RUNTIME(symbol->value) or (decl->value != NULL and decl->value->kind != ND_VALUE)) {
+		// the initializer tree is kept for codegen, and so is what it
+		// points to. the arena is left to it and a new one is started
+		self->scratch = Arena(self->counted.inner);
+		return value;
+	}
+
+	symbol->value = keep_value(self, symbol->value);
+	if (decl->value != NULL) {
+		((struct haste_ast_value*)decl->value)->value = symbol->value;
+	}
+	if (self->scratch_users == 0) {
+		arena_reset(&self->scratch);
+	}
+	return IS_BAD(value) then value otherwise symbol->value;
+}
+
+static struct haste_value report_vm_error(struct analyzer *self, struct vm_error err)
+{
+	if (err.code == ERR_COMPTIME_STEPS or err.code == ERR_COMPTIME_TIME) {
+		report_budget_exceeded(self, err.loc, err.code, err.trace, err.trace_calls, err.trace_len);
+	} else if (err.code == ERR_CALL_DEPTH_EXCEEDED) {
+		report_error(self, err.loc,
+			"Compile-time evaluation went deeper than {d} calls.", VM_MAX_CALL_DEPTH);
+	} else if (err.code == ERR_INT_OUT_OF_RANGE) {
+		report_error(self, err.loc,
+			"The value does not fit in its integer type.");
+	} else {
+		report_arith_error(self, err.op, err.code, (struct haste_type){0}, (struct haste_type){0}, err.loc);
+	}
+	return VAL_BAD;
+}
+
+// numeric initializers are compiled to bytecode instead of being folded one
+// `haste_value` at a time. anything the VM can't handle goes to the tree walker.
+static struct haste_value analyze_comptime_expr(struct analyzer *self, struct haste_ast_node *node, struct haste_type expected_type)
+{
+	const bool is_operation = node->kind == ND_BINARY or node->kind == ND_UNARY
+		or node->kind == ND_GROUPING or node->kind == ND_CAST;
+	if (g_options.no_comptime_vm or not is_operation or node->analyzed) {
+		return analyze_node(self, node, expected_type);
+	}
+
+	struct haste_value value;
+	struct vm_error err;
+	switch (vm_eval(&self->vm, node, &value, &err)) {
+	case VM_OK:
+		node->analyzed = true;
+		return value;
+	case VM_FAILED:
+		node->analyzed = true;
+		return report_vm_error(self, err);
+	case VM_UNSUPPORTED:
+		break;
+	}
+	return analyze_node(self, node, expected_type);
 }
 
 static struct haste_value analyze_unary(struct analyzer *self, struct haste_ast_unary *node, struct haste_type expected_type)
@@ -403,7 +835,10 @@ static struct haste_value analyze_unary(struct analyzer *self, struct haste_ast_
 				value = VAL_SCALAR(AS_TYPEID(typeof_value(value)), .integer = 0);
 			} else if (IS_SCALAR(value)) {
 				if (type_is_integer(typeof_value(value))) {
-					value.integer = -value.integer;
+					// wraps around, like it does at runtime
+					const struct haste_type_info *info = AS_TYPE_INFO(typeof_value(value));
+					value.integer = int_wrap((haste_int)(0 - (haste_uint)value.integer),
+					                         int_type_bits(info), info->is_unsigned);
 				} else if (type_is_float(typeof_value(value))) {
 					value.floating = -value.floating;
 				} else {
@@ -497,7 +932,7 @@ static struct haste_value analyze_string_lit(
 	struct haste_type expected_type)
 {
 	discard expected_type;
-	struct haste_object *obj = create_string(self->arena_allocator, (char *)node->value.chars, node->value.len);
+	struct haste_object *obj = create_string(self->comptime, (char *)node->value.chars, node->value.len);
 	struct haste_value result = VAL_OBJ(AS_TYPEID(ty_untyped_string), obj);
 	inject(self->arena_allocator, node, result);
 	return result;
@@ -525,6 +960,8 @@ static struct haste_value analyze_ident(
 			"Its here.");
 		return VAL_BAD;
 	}
+	node->slot = symbol->slot;
+	node->is_global = symbol->is_global;
 
 	value = symbol->value;
 	if (not symbol->is_constant) {
@@ -562,7 +999,7 @@ static struct haste_value analyze_int_bits(
 		}
 	}
 
-	struct haste_value result = type_get_int(node->bits, false);
+	struct haste_value result = type_get_int(node->bits, true);
 	inject(self->arena_allocator, node, result);
 	return result;
 }
@@ -697,6 +1134,14 @@ static struct haste_value analyze_grouping(struct analyzer *self, struct haste_a
 	return value;
 }
 
+// The name of a type created for `node`: the declaration's, when `node` is
+// what a variable declaration is initialized with. it goes into the type
+// info before type_pool_add, so nothing renames a type after its id is out.
+static const char *new_type_name(const struct analyzer *self, const struct haste_ast_node *node)
+{
+	return node == self->named_node then self->type_name otherwise NULL;
+}
+
 static struct haste_value analyze_distinct(struct analyzer *self, struct haste_ast_distinct *node, struct haste_type expected_type)
 {
 	try (type, analyze_node(self, node->child, expected_type)) {
@@ -706,7 +1151,11 @@ static struct haste_value analyze_distinct(struct analyzer *self, struct haste_a
 		struct haste_type tp = {0};
 		tp = into_type(type);
 
-		struct haste_value result = VAL_TYPE(type_pool_add(*AS_TYPE_INFO(tp)));
+		struct haste_type_info info = *AS_TYPE_INFO(tp);
+		const char *name = new_type_name(self, &node->base);
+		if (name != NULL) info.name = name;
+
+		struct haste_value result = VAL_TYPE(type_pool_add(info));
 		inject(self->arena_allocator, node, result);
 		return result;
 	}
@@ -731,7 +1180,7 @@ static struct haste_value analyze_cast(struct analyzer *self, struct haste_ast_c
 
 	try (value, analyze_node(self, node->expr, (struct haste_type){0}))
 	{
-		catch(result, err, value_cast(self->allocator, to, value))
+		catch(result, err, value_cast(self->comptime, to, value))
 		{
 			run_at_percent (1) {
 				report_error(self, &node->base,
@@ -762,9 +1211,12 @@ static struct haste_value analyze_var_decl(struct analyzer *self, struct haste_a
 {
 	discard expected_type;
 	const char *name = node->name.chars;
-	struct symbol *symbol = find_local_first(self, name);
+	struct symbol *symbol = hmget(*self->local, name);
 	symbol->is_constant = node->is_constant;
 	symbol->level = SYM_DEFINED;
+	if (not symbol->is_global) {
+		symbol->slot = node->slot = self->local_slots += 1;
+	}
 
 	if (node->type == NULL and node->value == NULL) {
 		report_error(self, &node->base, "You need to either specify the type or the value or both.");
@@ -774,43 +1226,51 @@ static struct haste_value analyze_var_decl(struct analyzer *self, struct haste_a
 	if (node->type != NULL) {
 		struct haste_value tp = analyze_node(self, node->type, (struct haste_type){0});
 		if (IS_BAD(tp)) {
-			fail_var_decl(symbol, &node->base);
+			emit_error_symbol(symbol, &node->base);
 		}
 		if (not IS_TYPE(tp)) {
 			report_error(self, node->type,
 						 "Expected a {value} got '{value}' instead.", ty_type, typeof_value(tp));
-			fail_var_decl(symbol, &node->base);
+			emit_error_symbol(symbol, &node->base);
 		}
 		type = into_type(tp);
 	}
 
 	struct haste_value value = VAL_UNINIT;
 	if (node->value != NULL) {
-		value = analyze_node(self, node->value, type);
+		const struct haste_ast_node *outer_node = self->named_node;
+		const char *outer_name = self->type_name;
+		self->named_node = node->value;
+		while (self->named_node->kind == ND_GROUPING)
+			self->named_node = ((const struct haste_ast_grouping*)self->named_node)->child;
+		self->type_name = name;
+		value = analyze_comptime_expr(self, node->value, type);
+		self->named_node = outer_node;
+		self->type_name = outer_name;
 		if (IS_BAD(value)) {
-			fail_var_decl(symbol, &node->base);
+			emit_error_symbol(symbol, &node->base);
 		}
 	}
 
 	if (IS_AUTO(type)) {
 		type = typeof_value(value);
 	} else if (IS_UNINIT(value)) {
-		value = default_for_type(self->allocator, type);
+		value = default_for_type(type);
 	}
 
 	if (not type_equal(type, typeof_value(value))) {
 		struct haste_type orig_type = typeof_value(value);
-		value = value_coerce(self->allocator, type, value);
+		struct haste_value orig_value = value;
+		value = value_coerce(self->comptime, type, value);
 		if (IS_BAD(value)) {
-			report_error(self, node->name_loc,
-				"cannot assign a value of type '{value}' to '{value}'.", orig_type, type);
-			fail_var_decl(symbol, &node->base);
-		}
-	}
-
-	if (IS_TYPE(value)) {
-		if (is_newly_created_type(into_type(value))) {
-			type_pool_set_name(AS_TYPEID(into_type(value)), name);
+			if (value.error_code == ERR_INT_OUT_OF_RANGE) {
+				report_error(self, node->name_loc,
+					"'{value}' does not fit in '{value}'.", orig_value, type);
+			} else {
+				report_error(self, node->name_loc,
+					"cannot assign a value of type '{value}' to '{value}'.", orig_type, type);
+			}
+			emit_error_symbol(symbol, &node->base);
 		}
 	}
 
@@ -835,8 +1295,6 @@ static struct haste_value analyze_var_decl(struct analyzer *self, struct haste_a
 		}
 	}
 
-	reset_new_type_counter();
-
 	return value;
 }
 
@@ -847,15 +1305,13 @@ static struct haste_struct_field *alloc_struct_items(struct Allocator alloc, siz
 	return alloc(alloc, sizeof(struct haste_struct_field) * SAFE_COUNT(count));
 }
 
-static struct haste_struct_object *alloc_struct_object(struct Allocator alloc, size_t field_count)
-{
-	return alloc(alloc, sizeof(struct haste_struct_object) + sizeof(struct haste_value) * SAFE_COUNT(field_count));
-}
-
 static struct haste_value analyze_struct_type(struct analyzer *self, struct haste_ast_struct_type *node, struct haste_type expected_type)
 {
 	discard expected_type;
-	struct haste_type_info type_info = { .kind = HASTE_TY_STRUCT };
+	struct haste_type_info type_info = {
+		.kind = HASTE_TY_STRUCT,
+		.name = new_type_name(self, &node->base),
+	};
 	struct haste_struct_type_info *st = &type_info.structure;
 
 	st->len = 0;
@@ -863,7 +1319,7 @@ static struct haste_value analyze_struct_type(struct analyzer *self, struct hast
 		st->len += field->name_count;
 	}
 
-	st->items = alloc_struct_items(self->allocator, st->len);
+	st->items = alloc_struct_items(type_allocator(self), st->len);
 
 	bool has_error = false;
 	size_t i = 0;
@@ -882,6 +1338,8 @@ static struct haste_value analyze_struct_type(struct analyzer *self, struct hast
 
 	if (has_error) return VAL_BAD;
 
+	struct_type_index_fields(type_allocator(self), st);
+	struct_type_build_shared(type_allocator(self), st);
 	struct haste_value result = VAL_TYPE(type_pool_add(type_info));
 	inject(self->arena_allocator, node, result);
 	return result;
@@ -899,13 +1357,9 @@ static struct haste_value analyze_automatic_struct_literal(struct analyzer *self
 		st->len += 1;
 	}
 
-	st->items = alloc_struct_items(self->allocator, st->len);
+	st->items = alloc_struct_items(type_allocator(self), st->len);
 
-	/* struct haste_struct_object *so = create(self->allocator, struct haste_struct_object, */
-	/* 	.base = { .kind = HASTE_OBJ_STRUCT }); */
-	/* so->fields = alloc(self->allocator, sizeof(struct haste_value) * SAFE_COUNT(st->len)); */
-	struct haste_struct_object *so = alloc_struct_object(self->allocator, st->len);
-	so->base.kind = HASTE_OBJ_STRUCT;
+	struct haste_struct_object *so = alloc_struct_object(self->comptime, st->len);
 
 	size_t i = 0;
 	leach (struct haste_ast_struct_lit_field, lit_field, node->fields) {
@@ -919,11 +1373,25 @@ static struct haste_value analyze_automatic_struct_literal(struct analyzer *self
 			.name = lit_field->name.chars,
 			.type = typeof_value(fv),
 		};
-		so->fields[i] = fv;
+		struct_object_put(so, st, i, fv);
 		i += 1;
 	}
 
-	struct haste_value result = VAL_OBJ(type_pool_add(type_info), so);
+	struct_type_index_fields(type_allocator(self), st);
+	struct_type_build_shared(type_allocator(self), st);
+	bool existed = false;
+	TypeID id = type_pool_intern(type_info, &existed);
+	if (existed) {
+		// the fields have no declared defaults, so the shared instances
+		// hold nothing allocated besides themselves
+		xdestroy(type_allocator(self), STRUCT_OBJECT_SIZE(st->len), st->shared_initial);
+		if (st->shared_default) xdestroy(type_allocator(self), STRUCT_OBJECT_SIZE(st->len), st->shared_default);
+		if (st->shared_zero) xdestroy(type_allocator(self), STRUCT_OBJECT_SIZE(st->len), st->shared_zero);
+		if (st->index) xdestroy(type_allocator(self), sizeof(uint32_t) * st->index_cap, st->index);
+		xdestroy(type_allocator(self), sizeof(struct haste_struct_field) * SAFE_COUNT(st->len), st->items);
+	}
+
+	struct haste_value result = VAL_OBJ(id, so);
 	inject(self->arena_allocator, node, result);
 	return result;
 }
@@ -963,7 +1431,7 @@ static struct haste_value analyze_struct_literal(struct analyzer *self, struct h
 
 	struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(struct_type);
 
-	struct haste_value result = make_value(self->allocator, struct_type);
+	struct haste_value result = make_value(self->comptime, struct_type);
 
 	struct haste_struct_object *so = AS_STRUCT(result);
 
@@ -981,7 +1449,7 @@ static struct haste_value analyze_struct_literal(struct analyzer *self, struct h
 			}
 			idx = positional_idx++;
 		} else {
-			idx = find_struct_field(st, lit_field->name.chars);
+			idx = struct_field_index(st, lit_field->name.chars);
 			if (idx < 0) {
 				report_error(self, &lit_field->base,
 					"Unknown field '{string}'.", lit_field->name);
@@ -998,10 +1466,10 @@ static struct haste_value analyze_struct_literal(struct analyzer *self, struct h
 			has_error = true;
 		}
 
-		catch (_, err, struct_set_field_by_index(self->allocator, &result, idx, fv))
+		catch (_, err, struct_set_field_by_index(self->comptime, &result, idx, fv))
 		{
 			discard err;
-			so->fields[idx] = VAL_BAD;
+			struct_object_put(so, st, idx, VAL_BAD);
 			report_error(self, &lit_field->base,
 						 "Cannot assign a value of type '{value}' to a value of type '{value}'",
 						 typeof_value(fv), st->items[idx].type);
@@ -1011,7 +1479,7 @@ static struct haste_value analyze_struct_literal(struct analyzer *self, struct h
 
 	// TODO: Probably gotta find a better way to iterate over struct's fields
 	iarreach (i, *st) {
-		if (IS_NONE(so->fields[i])) {
+		if (IS_NONE(struct_object_get(so, st, i))) {
 			report_error(self, &node->base,
 				"Forgot to set a value for `{s}`.", st->items[i].name);
 			has_error = true;
@@ -1045,6 +1513,9 @@ static struct haste_value analyze_func_decl(struct analyzer *self, struct haste_
 	// Save and set current return type
 	struct haste_type saved_return_type = self->current_return_type;
 	self->current_return_type = return_type;
+	const uint32_t saved_local_slots = self->local_slots;
+	self->local_slots = 0;
+	arrpush(default_allocator, self->open_functions, node);
 
 	// Update the function's symbol so callers can resolve the return type
 	struct symbol *func_sym = hmget(*self->local, node->name.chars);
@@ -1060,6 +1531,9 @@ static struct haste_value analyze_func_decl(struct analyzer *self, struct haste_
 	with_scope(self) {
 		// Register parameters
 		leach (struct haste_ast_func_param, param, node->params) {
+			param->first_slot = self->local_slots + 1;
+			self->local_slots += (uint32_t)param->name_count;
+
 			struct haste_type param_type = ty_auto;
 			if (param->type != NULL) {
 				struct haste_value tp = analyze_node(self, param->type, (struct haste_type){0});
@@ -1085,6 +1559,7 @@ static struct haste_value analyze_func_decl(struct analyzer *self, struct haste_
 				put_local_symbol(self, pname,
 					.level = SYM_DECLARED,
 					.is_constant = false,
+					.slot = param->first_slot + (uint32_t)i,
 					.type = param_type,
 					.value = VAL_UNINIT,
 					.node = NULL);
@@ -1092,7 +1567,10 @@ static struct haste_value analyze_func_decl(struct analyzer *self, struct haste_
 		}
 
 		if (node->body != NULL) {
+			const bool outer_in_body = self->in_function_body;
+			self->in_function_body = true;
 			struct haste_value body_val = analyze_node(self, node->body, return_type);
+			self->in_function_body = outer_in_body;
 			if (IS_BAD(body_val)) {
 				self->had_error = true;
 			} else if (type_equal(typeof_value(body_val), ty_void) and not type_equal(return_type, ty_void)) {
@@ -1103,11 +1581,64 @@ static struct haste_value analyze_func_decl(struct analyzer *self, struct haste_
 		}
 	}
 
+	node->local_count = self->local_slots;
+	self->local_slots = saved_local_slots;
 	self->current_return_type = saved_return_type;
+	self->open_functions.len -= 1;
 
 	return VAL_UNINIT;
 }
 
+// runs a call with comptime-known arguments in the VM. only works when the
+// callee compiles, which means its body is side-effect free. results are
+// memoized by the VM, so repeated (and recursive) calls are looked up.
+// outside a function body the value is needed, and a failure is an error.
+// in a body the fold is only tried: if it fails (a call too deep for the
+// VM, a budget) the call is lowered as it is and runs at runtime.
+static bool fold_func_call(struct analyzer *self, struct haste_ast_func_call *node, struct haste_value *out)
+{
+	const struct haste_ast_func_decl *decl = vm_function_of(self, node->callee, false);
+	if (decl == NULL) return false;
+	struct vm_function *fn = vm_compile_function(&self->vm, decl);
+	if (fn == NULL) return false;
+
+	size_t argc = 0;
+	leach (struct haste_ast_func_call_arg, arg, node->args) {
+		argc += 1;
+	}
+	if (argc != fn->param_count) return false;
+
+	struct haste_value args[SAFE_COUNT(argc)];
+	size_t i = 0;
+	leach (struct haste_ast_func_call_arg, arg, node->args) {
+		const struct haste_type param_type = into_type(VAL_TYPE(fn->param_types[i]));
+		args[i] = value_coerce(self->comptime, param_type, ((struct haste_ast_value*)arg->value)->value);
+		if (not IS_SCALAR(args[i])) return false;
+		i += 1;
+	}
+
+	const bool is_required = not self->in_function_body;
+	const uint64_t steps = self->vm.steps;
+	const uint64_t bytes = self->bytes;
+	const uint64_t ns = vm_now_ns();
+	struct vm_error err;
+	switch (vm_call(&self->vm, fn, args, out, &err)) {
+	case VM_OK:
+		return true;
+	case VM_FAILED:
+		if (not is_required) {
+			budget_refund(self, steps, bytes, ns);
+			return false;
+		}
+		*out = report_vm_error(self, err);
+		report_note(self, &node->base, "While evaluating this call at compile time.");
+		return true;
+	case VM_UNSUPPORTED:
+		return false;
+	}
+	return false;
+}
+
 static struct haste_value analyze_func_call(struct analyzer *self, struct haste_ast_func_call *node, struct haste_type expected_type)
 {
 	// Analyze callee - should resolve to a function name
@@ -1122,11 +1653,24 @@ static struct haste_value analyze_func_call(struct analyzer *self, struct haste_
 	}
 
 	// Analyze arguments
+	bool args_are_comptime = true;
 	leach (struct haste_ast_func_call_arg, arg, node->args) {
 		struct haste_value arg_val = analyze_node(self, arg->value, expected_type);
 		if (IS_BAD(arg_val)) return VAL_BAD;
 		if (not IS_RUNTIME(arg_val)) {
 			inject(self->arena_allocator, arg->value, arg_val);
+		} else {
+			args_are_comptime = false;
+		}
+	}
+
+	if (args_are_comptime and not g_options.no_comptime_vm) {
+		struct haste_value result = VAL_NONE;
+		if (fold_func_call(self, node, &result)) {
+			if (not IS_BAD(result)) {
+				inject(self->arena_allocator, node, result);
+			}
+			return result;
 		}
 	}
 
@@ -1134,6 +1678,13 @@ static struct haste_value analyze_func_call(struct analyzer *self, struct haste_
 	return VAL_RUNTIME((struct haste_ast_node*)node);
 }
 
+static bool ends_in_return(const struct haste_ast_block *node)
+{
+	const struct haste_ast_node *last = node->stmts;
+	while (last != NULL and last->next != NULL) last = last->next;
+	return last != NULL and last->kind == ND_RETURN;
+}
+
 static struct haste_value analyze_block(struct analyzer *self, struct haste_ast_block *node, struct haste_type expected_type)
 {
 	struct haste_value last_val = VAL_NONE;
@@ -1154,7 +1705,7 @@ static struct haste_value analyze_block(struct analyzer *self, struct haste_ast_
 		node->base.type = ty_void;
 		return VAL_UNINIT;
 	}
-	if (not is_comptime_known(last_val)) {
+	if (not is_comptime_known(last_val) or ends_in_return(node)) {
 		node->base.type = typeof_value(last_val);
 		return last_val;
 	}
@@ -1173,7 +1724,7 @@ static struct haste_value analyze_return(struct analyzer *self, struct haste_ast
 		if (not IS_AUTO(self->current_return_type)) {
 			struct haste_type val_type = typeof_value(val);
 			if (not type_equal(self->current_return_type, val_type)) {
-				struct haste_value coerced = value_coerce(self->allocator, self->current_return_type, val);
+				struct haste_value coerced = value_coerce(self->comptime, self->current_return_type, val);
 				if (IS_BAD(coerced)) {
 					report_error(self, node->value,
 						"Cannot return a value of type '{value}' from a function returning '{value}'.",
@@ -1193,13 +1744,105 @@ static struct haste_value analyze_return(struct analyzer *self, struct haste_ast
 	}
 
 	node->base.type = typeof_value(val);
-	if (not is_comptime_known(val)) {
-		return val;
+	if (is_comptime_known(val)) {
+		// the value folds, the `return` stays. it still leaves the function
+		inject(self->arena_allocator, node->value, val);
 	}
-	inject(self->arena_allocator, node, val);
 	return val;
 }
 
+// ── Conditionals ─────────────────────────────────────────────────
+
+static bool is_condition(struct haste_value cond)
+{
+	const struct haste_type type = typeof_value(cond);
+	return IS_ZERO(cond) or type_is_integer(type) or type_is_untyped_integer(type);
+}
+
+static struct haste_type branch_type(struct haste_value value)
+{
+	return IS_UNINIT(value) or IS_NONE(value) then ty_void otherwise typeof_value(value);
+}
+
+static bool adapts_to_other_branch(struct haste_type type)
+{
+	return type_is_untyped(type) or type_equal(type, ty_zero);
+}
+
+// comptime branches take the type of the `if`. runtime ones have to have it already
+static bool unify_branch(struct analyzer *self, struct haste_ast_node **branch, struct haste_value value, struct haste_type type)
+{
+	if (type_equal(branch_type(value), type)) return true;
+	if (not is_comptime_known(value)) return false;
+
+	struct haste_value coerced = value_coerce(self->comptime, type, value);
+	if (IS_BAD(coerced)) return false;
+	inject(self->arena_allocator, *branch, coerced);
+	return true;
+}
+
+// A comptime-known condition picks its branch right here. the other one
+// is never analyzed (so it's only parsed) and codegen skips it too, which
+// lets whole subsystems be compiled out behind a constant.
+static struct haste_value analyze_if(struct analyzer *self, struct haste_ast_if *node, struct haste_type expected_type)
+{
+	try (cond, analyze_node(self, node->cond, (struct haste_type){0}))
+	{
+		if (not is_condition(cond)) {
+			return bail(self, node->cond,
+				"The condition of an 'if' must be an integer, got '{value}'.", typeof_value(cond));
+		}
+
+		if (is_comptime_known(cond)) {
+			inject(self->arena_allocator, node->cond, cond);
+			struct haste_ast_node *taken = not IS_ZERO(cond) and cond.integer != 0
+				then node->then_branch
+				otherwise node->else_branch;
+			if (taken == NULL) {
+				node->base.type = ty_void;
+				return VAL_UNINIT;
+			}
+
+			struct haste_value value = analyze_node(self, taken, expected_type);
+			if (IS_BAD(value)) return value;
+			node->base.type = branch_type(value);
+			if (is_comptime_known(value)) {
+				inject(self->arena_allocator, node, value);
+			}
+			return value;
+		}
+	}
+
+	const struct haste_value then_val = analyze_node(self, node->then_branch, expected_type);
+	const struct haste_value else_val = node->else_branch != NULL
+		then analyze_node(self, node->else_branch, expected_type)
+		otherwise VAL_UNINIT;
+	if (IS_BAD(then_val) or IS_BAD(else_val)) return VAL_BAD;
+
+	struct haste_type type = ty_void;
+	if (node->else_branch != NULL) {
+		const struct haste_type then_type = branch_type(then_val);
+		const struct haste_type else_type = branch_type(else_val);
+		if (adapts_to_other_branch(then_type) and adapts_to_other_branch(else_type)) {
+			type = not IS_AUTO(expected_type) and expected_type.value.kind != 0
+				then expected_type
+				otherwise untyped_to_typed(then_type);
+		} else {
+			type = adapts_to_other_branch(then_type) then else_type otherwise then_type;
+		}
+
+		if (not unify_branch(self, &node->then_branch, then_val, type)
+		    or not unify_branch(self, &node->else_branch, else_val, type)) {
+			return bail(self, &node->base,
+				"The branches of this 'if' have different types, '{value}' and '{value}'.",
+				then_type, else_type);
+		}
+	}
+
+	node->base.type = type;
+	return VAL_RUNTIME((struct haste_ast_node*)node);
+}
+
 // ── Main dispatch ────────────────────────────────────────────────
 
 struct haste_value analyze_node(struct analyzer *self, struct haste_ast_node *node, struct haste_type expected_type)
@@ -1208,6 +1851,7 @@ struct haste_value analyze_node(struct analyzer *self, struct haste_ast_node *no
 		return node->kind == ND_VALUE then ((struct haste_ast_value*)node)->value otherwise VAL_BAD;
 	}
 	node->analyzed = true;
+	if (not budget_check(self, node)) return VAL_BAD;
 
 	switch (node->kind) {
 	case ND_STRUCT_FIELD:     unreachable();
@@ -1232,6 +1876,7 @@ struct haste_value analyze_node(struct analyzer *self, struct haste_ast_node *no
 	case ND_FUNC_CALL:      return analyze_func_call      (self, (void*)node, expected_type);
 	case ND_BLOCK:          return analyze_block          (self, (void*)node, expected_type);
 	case ND_RETURN:         return analyze_return         (self, (void*)node, expected_type);
+	case ND_IF:             return analyze_if             (self, (void*)node, expected_type);
 	case ND_INT_BITS:       return analyze_int_bits       (self, (void*)node, expected_type);
 	case ND_UINT_BITS:      return analyze_uint_bits      (self, (void*)node, expected_type);
 	case ND_STRING:         return analyze_string         (self, (void*)node, expected_type);
@@ -1265,6 +1910,15 @@ static const char *declaration_name(struct haste_ast_node *node)
 	}
 }
 
+static void set_declaration_slot(struct haste_ast_node *node, uint32_t slot)
+{
+	switch (node->kind) {
+	case ND_VAR_DECL:  ((struct haste_ast_var_decl*)node)->slot = slot;  break;
+	case ND_FUNC_DECL: ((struct haste_ast_func_decl*)node)->slot = slot; break;
+	default: break;
+	}
+}
+
 static Error prepare_scope(
 	struct analyzer *self,
 	struct haste_ast_node *nodes,
@@ -1288,38 +1942,479 @@ static Error prepare_scope(
 			result = ERROR;
 			continue;
 		}
+		uint32_t slot = 0;
+		if (top_level) {
+			slot = self->global_slots += 1;
+			set_declaration_slot(node, slot);
+		}
 		put_local_symbol(
 			self, name,
 			.level = top_level then SYM_UNDEFINED otherwise SYM_AHH,
+			.is_global = top_level,
+			.slot = slot,
 			.node = node);
 	}
 
 	return result;
 }
 
-Error analyze(struct Allocator allocator,
-              struct Allocator arena_allocator,
-              const source_file_id src)
+// ── Incremental analysis ─────────────────────────────────────────
+
+static uint64_t fingerprint_mix(uint64_t h, uint64_t v)
+{
+	return h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+}
+
+static uint64_t fingerprint_of(uint64_t ast_hash, struct analysis_cache_deps deps)
+{
+	uint64_t h = ast_hash;
+	iarreach (i, deps) {
+		h = fingerprint_mix(h, _hash_str(deps.items[i].name));
+		h = fingerprint_mix(h, deps.items[i].fingerprint);
+	}
+	return h;
+}
+
+// Cached values and the struct types created with a cache outlive the run
+// that made them, so they live in the cache's allocator instead of the
+// analysis one. the type pool keeps those types, a reused declaration hands
+// back the same TypeID.
+static struct Allocator type_allocator(struct analyzer *self)
+{
+	return self->cache then self->cache->allocator otherwise self->allocator;
+}
+
+static struct haste_object *copy_object(struct Allocator alloc, struct haste_type type, const struct haste_object *obj)
+{
+	switch (obj->kind) {
+	case HASTE_OBJ_STRING: {
+		const struct haste_string_object *so = (const void*)obj;
+		return create_string(alloc, so->data, so->len);
+	}
+	case HASTE_OBJ_STRUCT: {
+		const struct haste_struct_object *so = (const void*)obj;
+		const struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(type);
+		struct haste_struct_object *copy = alloc(alloc, STRUCT_OBJECT_SIZE(so->len));
+		memcpy(copy, so, STRUCT_OBJECT_SIZE(so->len));
+		copy->base.is_shared = true; // handed to every run that reuses it
+		for (uint32_t i = 0; i < copy->len; i += 1) {
+			struct haste_value field = struct_object_get(copy, st, i);
+			if (IS_OBJ(field)) {
+				field.obj = copy_object(alloc, st->items[i].type, field.obj);
+				struct_object_put(copy, st, i, field);
+			}
+		}
+		return &copy->base;
+	}
+	}
+	unreachable();
+}
+
+static struct haste_value copy_value(struct Allocator alloc, struct haste_value value)
+{
+	if (IS_OBJ(value)) {
+		value.obj = copy_object(alloc, typeof_value(value), value.obj);
+	}
+	return value;
+}
+
+// a field default lives as long as its struct type
+static struct haste_value keep_type_value(struct analyzer *self, struct haste_value value)
+{
+	return self->cache then copy_value(self->cache->allocator, value) otherwise keep_value(self, value);
+}
+
+// Only declarations that fold to a comptime value (or a type) can be
+// reused. runtime values point into the AST they were analyzed from.
+static bool is_cacheable_declaration(struct symbol *symbol)
+{
+	if (symbol->node->kind != ND_VAR_DECL) return false;
+	return is_comptime_known(symbol->value) or IS_TYPE(symbol->value);
+}
+
+static bool cached_dependencies_match(struct analyzer *self, struct symbol *symbol, struct analysis_cache_entry *entry)
+{
+	struct decl_trace *saved_trace = self->trace;
+	const enum symbol_level level = symbol->level;
+	self->trace = NULL;
+	symbol->level = SYM_DEFINED; // a dependency that now refers back to us is a cycle
+
+	bool matches = true;
+	iarreach (i, entry->deps) {
+		struct analysis_cache_dep dep = entry->deps.items[i];
+		struct symbol *s = hmget(*self->global, dep.name);
+		if (s == NULL) { matches = false; break; }
+
+		s = resolve_symbol(self, self->global, s);
+		if (s == &_recursion_sentinel or s->fingerprint != dep.fingerprint) {
+			matches = false;
+			break;
+		}
+	}
+
+	symbol->level = level;
+	self->trace = saved_trace;
+	return matches;
+}
+
+static void reuse_declaration(struct analyzer *self, struct symbol *symbol, const struct analysis_cache_entry *entry)
+{
+	struct haste_ast_var_decl *node = (void*)symbol->node;
+	node->base.analyzed = true;
+	node->base.type = entry->type;
+	node->is_explicitly_comptime = entry->is_explicitly_comptime;
+	if (node->type != NULL) {
+		inject(self->arena_allocator, node->type, into_value(entry->type));
+	}
+	if (node->value != NULL) {
+		inject(self->arena_allocator, node->value, entry->value);
+	}
+
+	symbol->is_constant = entry->is_constant;
+	symbol->type = entry->type;
+	symbol->value = entry->value;
+	symbol->level = SYM_DECLARED;
+	symbol->fingerprint = entry->fingerprint;
+}
+
+static void remember_declaration(struct analyzer *self, struct symbol *symbol, uint64_t hash, struct decl_trace trace)
+{
+	struct analysis_cache_entry *old = hmget(*self->cache, symbol->key);
+	if (old != NULL) {
+		arrfree(self->cache->allocator, old->deps);
+	}
+
+	const struct haste_ast_var_decl *node = (void*)symbol->node;
+	hmput(self->cache->allocator, *self->cache, ((struct analysis_cache_entry){
+		.key = symbol->key,
+		.ast_hash = hash,
+		.fingerprint = symbol->fingerprint,
+		.deps = trace.deps,
+		.is_constant = symbol->is_constant,
+		.is_explicitly_comptime = node->is_explicitly_comptime,
+		.type = symbol->type,
+		.value = copy_value(self->cache->allocator, symbol->value),
+	}));
+}
+
+// ── Dependency order ─────────────────────────────────────────────
+
+struct pending_decl {
+	struct symbol *symbol;
+	bool expanded;
+	// open while its dependencies are analyzed, so they are blamed on it.
+	// its own evaluation opens a fresh one in analyze_declaration()
+	struct budget_scope *budget;
+};
+
+struct pending_decls {
+	size_t cap, len;
+	struct pending_decl *items;
+};
+
+// Pushes the undefined global constants `node` mentions. Blocks and
+// functions are skipped, their names may refer to locals.
+static void push_referenced_globals(struct analyzer *self, struct pending_decls *stack, const struct haste_ast_node *node)
+{
+	if (node == NULL) return;
+
+	switch (node->kind) {
+	case ND_IDENT: {
+		struct symbol *s = hmget(*self->global, ((const struct haste_ast_ident*)node)->value.chars);
+		if (s != NULL and s->level == SYM_UNDEFINED and s->node->kind == ND_VAR_DECL) {
+			arrpush(default_allocator, *stack, ((struct pending_decl){ .symbol = s }));
+		}
+	} break;
+	case ND_BINARY:
+		push_referenced_globals(self, stack, ((const struct haste_ast_binary*)node)->lhs);
+		push_referenced_globals(self, stack, ((const struct haste_ast_binary*)node)->rhs);
+		break;
+	case ND_UNARY:    push_referenced_globals(self, stack, ((const struct haste_ast_unary*)node)->rhs); break;
+	case ND_ACCESS:   push_referenced_globals(self, stack, ((const struct haste_ast_access*)node)->lhs); break;
+	case ND_GROUPING: push_referenced_globals(self, stack, ((const struct haste_ast_grouping*)node)->child); break;
+	// only the condition. a branch that is pruned must not pull anything in
+	case ND_IF:       push_referenced_globals(self, stack, ((const struct haste_ast_if*)node)->cond); break;
+	case ND_DISTINCT: push_referenced_globals(self, stack, ((const struct haste_ast_distinct*)node)->child); break;
+	case ND_CAST:
+		push_referenced_globals(self, stack, ((const struct haste_ast_cast*)node)->to);
+		push_referenced_globals(self, stack, ((const struct haste_ast_cast*)node)->expr);
+		break;
+	case ND_STRUCT_TYPE:
+		leach (const struct haste_ast_struct_field, field, ((const struct haste_ast_struct_type*)node)->fields) {
+			push_referenced_globals(self, stack, field->type);
+			push_referenced_globals(self, stack, field->default_value);
+		}
+		break;
+	case ND_STRUCT_LITERAL: {
+		const struct haste_ast_struct_literal *n = (const void*)node;
+		push_referenced_globals(self, stack, n->type_expr);
+		leach (const struct haste_ast_struct_lit_field, field, n->fields) {
+			push_referenced_globals(self, stack, field->value);
+		}
+	} break;
+	case ND_FUNC_CALL: {
+		const struct haste_ast_func_call *n = (const void*)node;
+		push_referenced_globals(self, stack, n->callee);
+		leach (const struct haste_ast_func_call_arg, arg, n->args) {
+			push_referenced_globals(self, stack, arg->value);
+		}
+	} break;
+	default: break;
+	}
+}
+
+// Analyzes the global constants `root` depends on before `root` itself,
+// deepest first, with an explicit stack. without it every link of a
+// chain like `const a0 = a1 + 1; const a1 = a2 + 1; ...` is a nested
+// analyze_node() call and a long enough chain overflows the native stack.
+//
+// The expanded entries of the stack are the current path. on a cycle we
+// stop and let the recursive path report "Recursive declaration" exactly
+// where it always did.
+static void analyze_dependencies_first(struct analyzer *self, struct symbol *root)
+{
+	if (root->node->kind != ND_VAR_DECL) return;
+
+	struct pending_decls stack = {0};
+	arrpush(default_allocator, stack, ((struct pending_decl){ .symbol = root }));
+
+	while (stack.len > 0) {
+		struct pending_decl *top = &stack.items[stack.len - 1];
+		struct symbol *s = top->symbol;
+		if (s->level != SYM_UNDEFINED) {
+			stack.len -= 1;
+			continue;
+		}
+		if (top->expanded) {
+			stack.len -= 1;
+			s->on_path = false;
+			if (s != root) {
+				budget_leave(self, top->budget);
+				xdestroy(default_allocator, sizeof(*top->budget), top->budget);
+				discard analyze_declaration(self, s);
+			}
+			continue;
+		}
+
+		top->expanded = true;
+		s->on_path = true;
+		if (s != root) {
+			top->budget = create(default_allocator, struct budget_scope);
+			budget_enter(self, top->budget, s);
+		}
+		const size_t first = stack.len;
+		parse_declaration_tree(s->node);
+		const struct haste_ast_var_decl *decl = (void*)s->node;
+		push_referenced_globals(self, &stack, decl->type);
+		push_referenced_globals(self, &stack, decl->value);
+
+		for (size_t i = first; i < stack.len; i += 1) {
+			if (not stack.items[i].symbol->on_path) continue;
+			// a cycle. the recursive path reports it, the scopes close innermost first
+			for (size_t j = stack.len; j > 0; j -= 1) {
+				struct pending_decl *pending = &stack.items[j - 1];
+				pending->symbol->on_path = false;
+				if (pending->budget == NULL) continue;
+				budget_leave(self, pending->budget);
+				xdestroy(default_allocator, sizeof(*pending->budget), pending->budget);
+			}
+			stack.len = 0;
+			break;
+		}
+	}
+	arrfree(default_allocator, stack);
+}
+
+// Top-level declarations are always analyzed in the global scope, no
+// matter which local scope happened to reference them first.
+static struct haste_value evaluate_declaration(struct analyzer *self, struct symbol *symbol)
+{
+	struct scope *saved_local = self->local;
+	self->local = self->global;
+
+	if (self->cache == NULL) {
+		struct haste_value value = evaluate_in_scratch(self, symbol);
+		self->local = saved_local;
+		return value;
+	}
+
+	const uint64_t hash = ast_hash(symbol->node);
+	symbol->fingerprint = hash; // provisional, until the dependencies are known
+
+	struct analysis_cache_entry *entry = hmget(*self->cache, symbol->key);
+	if (entry != NULL and entry->ast_hash == hash
+	    and cached_dependencies_match(self, symbol, entry)) {
+		reuse_declaration(self, symbol, entry);
+		self->cache->reused += 1;
+		self->local = saved_local;
+		return symbol->value;
+	}
+	self->cache->recomputed += 1;
+
+	struct decl_trace trace = { .symbol = symbol };
+	struct decl_trace *saved_trace = self->trace;
+	const size_t error_count = self->error_count;
+
+	self->trace = &trace;
+	struct haste_value value = evaluate_in_scratch(self, symbol);
+	self->trace = saved_trace;
+	self->local = saved_local;
+
+	symbol->fingerprint = fingerprint_of(hash, trace.deps);
+	if (self->error_count == error_count and is_cacheable_declaration(symbol)) {
+		remember_declaration(self, symbol, hash, trace);
+	} else {
+		arrfree(self->cache->allocator, trace.deps);
+	}
+	return value;
+}
+
+static struct haste_value analyze_declaration(struct analyzer *self, struct symbol *symbol)
+{
+	// past --max-errors nothing more is analyzed. with a `main`, everything
+	// is reached from inside its declaration, so the top-level loop is too late
+	if (diagnostics_limit_reached()) emit_error_symbol(symbol, symbol->node);
+
+	// open before the dependencies, which are needed by this declaration
+	struct budget_scope scope;
+	budget_enter(self, &scope, symbol);
+	parse_declaration_tree(symbol->node);
+	analyze_dependencies_first(self, symbol);
+	// nodes made for a declaration with a tree arena of its own go there and
+	// are freed with it. everything else, functions included, uses the file's
+	const struct Allocator outer_arena = self->counted_arena.inner;
+	const struct haste_ast_var_decl *decl = (void*)symbol->node;
+	self->counted_arena.inner = symbol->node->kind == ND_VAR_DECL and decl->tree_arena != NULL
+		then arena_get_allocator(decl->tree_arena)
+		otherwise self->file_arena;
+	const bool outer_in_body = self->in_function_body;
+	self->in_function_body = false;
+	struct haste_value value = evaluate_declaration(self, symbol);
+	self->in_function_body = outer_in_body;
+	self->counted_arena.inner = outer_arena;
+	budget_leave(self, &scope);
+	if (symbol->level != SYM_DECLARED) {
+		// the budget ran out before its node was even looked at
+		symbol->value = VAL_BAD;
+		symbol->type = into_type(VAL_BAD);
+		symbol->level = SYM_DECLARED;
+	}
+
+	// after an error nothing is lowered, so the sink stops hearing about them
+	if (self->sink.done != NULL and symbol->is_global and symbol->node->analyzed and not self->had_error) {
+		self->sink.done(self->sink.ctx, symbol->node);
+	}
+	return value;
+}
+
+static void init_vm(struct analyzer *self)
+{
+	vm_init(&self->vm, default_allocator, (struct vm_resolver){
+		.ctx = self,
+		.lookup = vm_lookup,
+		.type_of = vm_type_of,
+		.function_of = vm_function_of,
+	});
+}
+
+static void deinit_vm(struct analyzer *self)
+{
+	vm_deinit(&self->vm);
+	arrfree(default_allocator, self->open_functions);
+}
+
+void analysis_cache_free(struct analysis_cache *cache)
+{
+	iarreach (i, *cache) {
+		arrfree(cache->allocator, cache->items[i].deps);
+	}
+	hmfree(cache->allocator, *cache);
+	*cache = (struct analysis_cache){ .allocator = cache->allocator };
+}
+
+// When the file has a `main` function, analysis starts from it and every
+// other declaration is analyzed the first time something references it.
+// declarations nothing reaches are never type-checked (or lowered, since
+// codegen skips nodes that were not analyzed). files without a `main` are
+// libraries, so all of their declarations are roots.
+static struct symbol *entry_point(struct analyzer *self)
+{
+	if (g_options.check_all) return NULL;
+
+	struct symbol *main = hmget(*self->global, "main");
+	if (main == NULL or main->node->kind != ND_FUNC_DECL) return NULL;
+	return main;
+}
+
+static Error analyze_source(struct Allocator allocator,
+                            struct Allocator arena_allocator,
+                            const source_file_id src,
+                            struct analysis_cache *cache,
+                            struct declaration_sink sink)
 {
 	struct analyzer analyzer = {
 		.allocator = allocator,
 		.arena_allocator = arena_allocator,
 		.src = src,
+		.cache = cache,
+		.sink = sink,
 	};
+	init_vm(&analyzer);
+	init_budget(&analyzer);
+	if (cache != NULL) {
+		cache->reused = 0;
+		cache->recomputed = 0;
+	}
+
 	with_scope(&analyzer) {
 		struct haste_ast_node *nodes = get_source_file_ast(src);
+		// no return in here, the scope and the VM still have to be torn down
 		Error err = prepare_scope(&analyzer, nodes, true);
-		if (err) return ERROR;
-
-		struct haste_ast_node *root = get_source_file_ast(src);
-		leach (struct haste_ast_node, node, root) {
-			analyze_node(&analyzer, node, (struct haste_type){0});
-			reset_temporary_allocator();
+		if (err) analyzer.had_error = true;
+
+		if (not err) {
+			const struct symbol *entry = entry_point(&analyzer);
+			leach (struct haste_ast_node, node, nodes) {
+				struct symbol *symbol = node_is_declaration(node)
+					then hmget(*analyzer.global, declaration_name(node))
+					otherwise NULL;
+				if (symbol == NULL or symbol->node != node) {
+					analyze_node(&analyzer, node, (struct haste_type){0});
+				} else if (symbol->level == SYM_UNDEFINED and (entry == NULL or symbol == entry)) {
+					discard analyze_declaration(&analyzer, symbol);
+				}
+				reset_temporary_allocator();
+				if (diagnostics_limit_reached() or budget_exhausted(&analyzer)) break;
+			}
 		}
 	}
+	deinit_vm(&analyzer);
 	return analyzer.had_error then ERROR otherwise OK;
 }
 
+Error analyze_incremental(struct Allocator allocator,
+                          struct Allocator arena_allocator,
+                          const source_file_id src,
+                          struct analysis_cache *cache)
+{
+	return analyze_source(allocator, arena_allocator, src, cache, (struct declaration_sink){0});
+}
+
+Error analyze_streaming(struct Allocator allocator,
+                        struct Allocator arena_allocator,
+                        const source_file_id src,
+                        struct declaration_sink sink)
+{
+	return analyze_source(allocator, arena_allocator, src, NULL, sink);
+}
+
+Error analyze(struct Allocator allocator,
+              struct Allocator arena_allocator,
+              const source_file_id src)
+{
+	return analyze_incremental(allocator, arena_allocator, src, NULL);
+}
+
 Error analyze_one_node(
 	struct Allocator allocator,
 	struct Allocator arena_allocator,
@@ -1331,8 +2426,11 @@ Error analyze_one_node(
 		.arena_allocator = arena_allocator,
 		.src = -1,
 	};
+	init_vm(&analyzer);
+	init_budget(&analyzer);
 	with_scope(&analyzer) {
 		*out = analyze_node(&analyzer, node, into_type(VAL_NONE));
 	}
+	deinit_vm(&analyzer);
 	return analyzer.had_error then ERROR otherwise OK;
 }
@@ -43,6 +43,7 @@ static const char *HASTE_AST_NODE_KIND[] =
 	[ND_FUNC_CALL_ARG]= "func_call_arg",
 	[ND_BLOCK]        = "block",
 	[ND_RETURN]       = "return",
+	[ND_IF]           = "if",
 };
 
 static int print_haste_ast_node_kind(stream_t file, const enum haste_ast_node_kind kind)
@@ -131,7 +132,8 @@ static int print_haste_ast_node(stream_t file, const struct haste_ast_node *node
 	case ND_INTEGER_LIT:
 		{
 			const struct haste_ast_integer_lit *n = (const struct haste_ast_integer_lit*)node;
-			printed_amount += sprint(file, "\"value\": {i64}", n->value);
+			printed_amount += sprint(file, "\"value\": ");
+			printed_amount += print_haste_int(file, n->value, false);
 		}
 		break;
 	case ND_FLOAT_LIT:
@@ -280,6 +282,20 @@ static int print_haste_ast_node(stream_t file, const struct haste_ast_node *node
 			else printed_amount += sprint(file, "null");
 		}
 		break;
+	case ND_IF:
+		{
+			const struct haste_ast_if *n = (const struct haste_ast_if*)node;
+			printed_amount += sprint(file, "\"cond\": ");
+			printed_amount += print_haste_ast_node(file, n->cond);
+			printed_amount += sprint(file, ",");
+			printed_amount += sprint(file, "\"then\": ");
+			printed_amount += print_haste_ast_node(file, n->then_branch);
+			printed_amount += sprint(file, ",");
+			printed_amount += sprint(file, "\"else\": ");
+			if (n->else_branch) printed_amount += print_haste_ast_node(file, n->else_branch);
+			else printed_amount += sprint(file, "null");
+		}
+		break;
 	case ND_FUNC_PARAM:
 	case ND_FUNC_CALL_ARG:
 		unreachable();
@@ -330,3 +346,186 @@ bool node_is_declaration(const struct haste_ast_node *node)
 {
 	return node->kind == ND_VAR_DECL or node->kind == ND_FUNC_DECL;
 }
+
+void free_declaration_tree(struct haste_ast_node *decl)
+{
+	if (decl->kind != ND_VAR_DECL) return;
+	struct haste_ast_var_decl *var = (void*)decl;
+	if (var->tree_arena == NULL) return;
+
+	arena_free(var->tree_arena);
+	xdestroy(default_allocator, sizeof(struct Arena), var->tree_arena);
+	var->tree_arena = NULL;
+	var->type = NULL;
+	var->value = NULL;
+}
+
+// ── Structural hashing ───────────────────────────────────────────
+
+static uint64_t hash_mix(uint64_t h, uint64_t v)
+{
+	return h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+}
+
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	for (size_t i = 0; i < len; i += 1) {
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+static uint64_t hash_string(uint64_t h, struct string s)
+{
+	h = hash_mix(h, s.len);
+	if (s.chars == NULL) return h;
+	return hash_bytes(h, s.chars, s.len);
+}
+
+static uint64_t hash_node(uint64_t h, const struct haste_ast_node *node);
+
+static uint64_t hash_list(uint64_t h, const struct haste_ast_node *node)
+{
+	size_t count = 0;
+	leach (const struct haste_ast_node, item, node) {
+		h = hash_node(h, item);
+		count += 1;
+	}
+	return hash_mix(h, count);
+}
+
+static uint64_t hash_names(uint64_t h, size_t count, const struct string *names)
+{
+	for (size_t i = 0; i < count; i += 1) {
+		h = hash_string(h, names[i]);
+	}
+	return hash_mix(h, count);
+}
+
+static uint64_t hash_node(uint64_t h, const struct haste_ast_node *node)
+{
+	if (node == NULL) return hash_mix(h, 0xdeadULL);
+
+	h = hash_mix(h, (uint64_t)node->kind + 1);
+	switch (node->kind) {
+	case ND_VALUE: {
+		const struct haste_ast_value *n = (const void*)node;
+		h = hash_mix(h, n->value.kind);
+		h = hash_mix(h, n->value.type_id);
+		if (IS_SCALAR(n->value) and (TYPE_FLAGS(n->value.type_id) & TYPE_FLAG_FLOAT))
+			h = hash_bytes(h, &n->value.floating, sizeof(n->value.floating));
+		else if (IS_SCALAR(n->value))
+			h = hash_bytes(h, &n->value.integer, sizeof(n->value.integer));
+		else if (IS_TYPE(n->value))
+			h = hash_mix(h, n->value.type);
+		else
+			h = hash_bytes(h, &n->value.obj, sizeof(n->value.obj));
+	} break;
+	case ND_INTEGER_LIT: {
+		const struct haste_ast_integer_lit *n = (const void*)node;
+		h = hash_bytes(h, &n->value, sizeof(n->value));
+	} break;
+	case ND_FLOAT_LIT: {
+		const struct haste_ast_float_lit *n = (const void*)node;
+		h = hash_bytes(h, &n->value, sizeof(n->value));
+	} break;
+	case ND_STRING_LIT: h = hash_string(h, ((const struct haste_ast_string_lit*)node)->value); break;
+	case ND_IDENT:      h = hash_string(h, ((const struct haste_ast_ident*)node)->value); break;
+	case ND_BINARY: {
+		const struct haste_ast_binary *n = (const void*)node;
+		h = hash_mix(h, n->op);
+		h = hash_node(h, n->lhs);
+		h = hash_node(h, n->rhs);
+	} break;
+	case ND_UNARY: {
+		const struct haste_ast_unary *n = (const void*)node;
+		h = hash_mix(h, n->op);
+		h = hash_node(h, n->rhs);
+	} break;
+	case ND_ACCESS: {
+		const struct haste_ast_access *n = (const void*)node;
+		h = hash_node(h, n->lhs);
+		h = hash_string(h, n->field);
+	} break;
+	case ND_INT_BITS:  h = hash_mix(h, ((const struct haste_ast_int_bits*)node)->bits); break;
+	case ND_UINT_BITS: h = hash_mix(h, ((const struct haste_ast_uint_bits*)node)->bits); break;
+	case ND_GROUPING:  h = hash_node(h, ((const struct haste_ast_grouping*)node)->child); break;
+	case ND_DISTINCT:  h = hash_node(h, ((const struct haste_ast_distinct*)node)->child); break;
+	case ND_CAST: {
+		const struct haste_ast_cast *n = (const void*)node;
+		h = hash_node(h, n->to);
+		h = hash_node(h, n->expr);
+	} break;
+	case ND_STRING:
+	case ND_CSTR:
+	case ND_INT:
+	case ND_UINT:
+	case ND_FLOAT:
+	case ND_USIZE:
+	case ND_VOID:
+	case ND_AUTO:
+	case ND_TYPE:
+		break;
+	case ND_STRUCT_TYPE: {
+		const struct haste_ast_struct_type *n = (const void*)node;
+		leach (const struct haste_ast_struct_field, field, n->fields) {
+			h = hash_names(h, field->name_count, field->names);
+			h = hash_node(h, field->type);
+			h = hash_node(h, field->default_value);
+		}
+	} break;
+	case ND_STRUCT_LITERAL: {
+		const struct haste_ast_struct_literal *n = (const void*)node;
+		h = hash_node(h, n->type_expr);
+		leach (const struct haste_ast_struct_lit_field, field, n->fields) {
+			h = hash_string(h, field->name);
+			h = hash_node(h, field->value);
+		}
+	} break;
+	case ND_VAR_DECL: {
+		const struct haste_ast_var_decl *n = (const void*)node;
+		h = hash_mix(h, (uint64_t)n->is_constant | (uint64_t)n->is_explicitly_comptime << 1);
+		h = hash_string(h, n->name);
+		h = hash_node(h, n->type);
+		h = hash_node(h, n->value);
+	} break;
+	case ND_FUNC_DECL: {
+		const struct haste_ast_func_decl *n = (const void*)node;
+		h = hash_string(h, n->name);
+		leach (const struct haste_ast_func_param, param, n->params) {
+			h = hash_names(h, param->name_count, param->names);
+			h = hash_node(h, param->type);
+		}
+		h = hash_node(h, n->return_type);
+		h = hash_node(h, n->body);
+	} break;
+	case ND_FUNC_CALL: {
+		const struct haste_ast_func_call *n = (const void*)node;
+		h = hash_node(h, n->callee);
+		leach (const struct haste_ast_func_call_arg, arg, n->args) {
+			h = hash_node(h, arg->value);
+		}
+	} break;
+	case ND_STRUCT_FIELD:
+	case ND_STRUCT_LIT_FIELD:
+	case ND_FUNC_PARAM:
+	case ND_FUNC_CALL_ARG:
+		unreachable();
+	case ND_BLOCK:         h = hash_list(h, ((const struct haste_ast_block*)node)->stmts); break;
+	case ND_RETURN:        h = hash_node(h, ((const struct haste_ast_return*)node)->value); break;
+	case ND_IF: {
+		const struct haste_ast_if *n = (const void*)node;
+		h = hash_node(h, n->cond);
+		h = hash_node(h, n->then_branch);
+		h = hash_node(h, n->else_branch);
+	} break;
+	}
+	return h;
+}
+
+uint64_t ast_hash(const struct haste_ast_node *node)
+{
+	return hash_node(1469598103934665603ULL, node);
+}
@@ -2,40 +2,93 @@
 #include "my_common.h"
 #include "my_stream.h"
 #include "llvm-c/Core.h"
+#include <llvm-c/Analysis.h>
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Linker.h>
+#include <llvm-c/LLJIT.h>
+#include <llvm-c/Orc.h>
+#include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
+#include <llvm-c/Transforms/PassBuilder.h>
 #include <assert.h>
+#include <string.h>
+#include <threads.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#  include <direct.h>
+#  include <fcntl.h>
+#  include <io.h>
+#  define make_directory(path_) _mkdir(path_)
+#  define dup _dup
+#  define dup2 _dup2
+#  define close _close
+#  define read _read
+#  define pipe(fds_) _pipe((fds_), 4096, _O_BINARY)
+#else
+#  include <unistd.h>
+#  define make_directory(path_) mkdir((path_), 0777)
+#endif
 #include <llvm-c/Types.h>
 
-struct type_map_entry {
-	TypeID haste_type;
-	LLVMTypeRef llvm_type;
-};
-
-struct local_entry {
-	const char *name;
-	LLVMValueRef value;
-	LLVMTypeRef elem_type;
+// a comptime string or struct already lowered into the module
+struct constant_slot {
+	uint64_t hash;
+	struct haste_value value;
+	LLVMValueRef llvm; // NULL for an empty slot
 };
 
 struct codegen_context {
 	LLVMContextRef llvm_ctx;
 	LLVMBuilderRef builder;
-	LLVMModuleRef module;
+	LLVMModuleRef module; // NULL once handed to the JIT
+	bool owns_llvm_ctx;   // false when the JIT's thread-safe context owns it
 	struct Allocator allocator;
-	struct { size_t cap, len; struct type_map_entry *items; } struct_types;
+	// indexed by TypeID, NULL until the type is first lowered. see llvm_type
+	struct { size_t cap, len; LLVMTypeRef *items; } types;
+	size_t struct_count; // numbers the named LLVM structs
+	uint64_t string_count; // numbers the string globals
 	LLVMValueRef current_func;
-	struct { size_t cap, len; struct local_entry *items; } locals;
+	// indexed by the slots analysis put on identifiers (see haste_ast_ident):
+	// the allocas of the current function, and the globals and functions
+	struct { size_t cap, len; LLVMValueRef *items; } locals;
+	struct { size_t cap, len; LLVMValueRef *items; } globals;
+	// the top-level declaration behind each global slot. a global used before
+	// its definition is lowered is declared from it, see get_global
+	struct { size_t cap, len; const struct haste_ast_node **items; } decls;
+	// open addressing, see pooled_constant
+	struct { size_t cap, len; struct constant_slot *items; } constants;
 };
 
 static LLVMValueRef codegen_expr(struct codegen_context *ctx, const struct haste_ast_node *node);
+static LLVMTypeRef llvm_type(struct codegen_context *ctx, struct haste_type type);
 static LLVMValueRef codegen_stmt(struct codegen_context *ctx, const struct haste_ast_node *node);
+static void declare_global_node(struct codegen_context *ctx, const struct haste_ast_node *node);
+
+static struct codegen_context context_init(struct Allocator allocator, LLVMContextRef llvm_ctx, bool owns_llvm_ctx, const char *module_name)
+{
+	return (struct codegen_context){
+		.llvm_ctx = llvm_ctx,
+		.owns_llvm_ctx = owns_llvm_ctx,
+		.builder = LLVMCreateBuilderInContext(llvm_ctx),
+		.module = LLVMModuleCreateWithNameInContext(module_name, llvm_ctx),
+		.allocator = allocator,
+	};
+}
 
 static void context_deinit(struct codegen_context *ctx)
 {
 	LLVMDisposeBuilder(ctx->builder);
-	LLVMDisposeModule(ctx->module);
-	LLVMContextDispose(ctx->llvm_ctx);
-	arrfree(ctx->allocator, ctx->struct_types);
+	if (ctx->module) LLVMDisposeModule(ctx->module);
+	if (ctx->owns_llvm_ctx) LLVMContextDispose(ctx->llvm_ctx);
+	arrfree(ctx->allocator, ctx->types);
 	arrfree(ctx->allocator, ctx->locals);
+	arrfree(ctx->allocator, ctx->globals);
+	arrfree(ctx->allocator, ctx->decls);
+	if (ctx->constants.items) {
+		xdestroy(ctx->allocator, sizeof(struct constant_slot) * ctx->constants.cap, ctx->constants.items);
+	}
 	*ctx = (struct codegen_context){0};
 }
 
@@ -57,57 +110,89 @@ static LLVMTypeRef t_i8ptr(struct codegen_context *ctx)
 
 // ── Haste type → LLVM type ────────────────────────────────────────
 
-static LLVMTypeRef llvm_type(struct codegen_context *ctx, struct haste_type type)
+static void remember_type(struct codegen_context *ctx, TypeID id, LLVMTypeRef llvm_ty)
 {
-	struct haste_type_info *tp = AS_TYPE_INFO(type);
-
-	if (tp->kind == HASTE_TY_UNTYPED_INT or tp->kind == HASTE_TY_ZERO) return t_i32(ctx);
-	if (tp->kind == HASTE_TY_USIZE) return t_i64(ctx);
-	if (tp->kind == HASTE_TY_FLOAT or tp->kind == HASTE_TY_UNTYPED_FLOAT) return t_f32(ctx);
-	if (tp->kind == HASTE_TY_VOID) return t_void(ctx);
-	if (tp->kind == HASTE_TY_UNTYPED_STRING or tp->kind == HASTE_TY_CSTR or tp->kind == HASTE_TY_STRING) return t_i8ptr(ctx);
+	if (id >= ctx->types.len) {
+		// grows with the pool, so most types after the first miss land in place
+		const size_t len = type_pool_len() > id then type_pool_len() otherwise id + 1;
+		while (ctx->types.cap < len) arrgrow(ctx->allocator, ctx->types);
+		memset(ctx->types.items + ctx->types.len, 0, sizeof(LLVMTypeRef) * (ctx->types.cap - ctx->types.len));
+		ctx->types.len = ctx->types.cap;
+	}
+	ctx->types.items[id] = llvm_ty;
+}
 
-	if (tp->kind == HASTE_TY_INT or tp->kind == HASTE_TY_UINT) {
-		return LLVMIntTypeInContext(ctx->llvm_ctx, tp->bit_size);
+// NULL for the types that need more than a lookup in the LLVM context
+static LLVMTypeRef lower_scalar_type(struct codegen_context *ctx, const struct haste_type_info *tp)
+{
+	switch (tp->kind) {
+	case HASTE_TY_UNTYPED_INT:
+	case HASTE_TY_ZERO:           return t_i32(ctx);
+	case HASTE_TY_USIZE:          return t_i64(ctx);
+	case HASTE_TY_FLOAT:
+	case HASTE_TY_UNTYPED_FLOAT:  return t_f32(ctx);
+	case HASTE_TY_VOID:           return t_void(ctx);
+	case HASTE_TY_UNTYPED_STRING:
+	case HASTE_TY_CSTR:
+	case HASTE_TY_STRING:         return t_i8ptr(ctx);
+	case HASTE_TY_INT:
+	case HASTE_TY_UINT:           return LLVMIntTypeInContext(ctx->llvm_ctx, tp->bit_size);
+	default:                      return NULL;
 	}
+}
 
-	if (tp->kind == HASTE_TY_STRUCT or tp->kind == HASTE_TY_AUTO_STRUCT) {
-		struct haste_type_info *type_info = AS_TYPE_INFO(type);
-		struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(type);
+static LLVMTypeRef lower_struct_type(struct codegen_context *ctx, struct haste_type type)
+{
+	struct haste_type_info *type_info = AS_TYPE_INFO(type);
+	struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(type);
 
-		for (size_t i = 0; i < ctx->struct_types.len; i += 1) {
-			if (ctx->struct_types.items[i].haste_type == AS_TYPEID(type)) {
-				return ctx->struct_types.items[i].llvm_type;
-			}
-		}
+	char *name = tsprint("struct.type.{s}.{z}", type_info->name then type_info->name otherwise "auto", ctx->struct_count++);
+	LLVMTypeRef llvm_st = LLVMStructCreateNamed(ctx->llvm_ctx, name);
+	// remembered before the members, a member can lead back to this struct
+	remember_type(ctx, AS_TYPEID(type), llvm_st);
 
-		char *name = tsprint("struct.type.{s}.{z}", type_info->name then type_info->name otherwise "auto", ctx->struct_types.len);
-		LLVMTypeRef llvm_st = LLVMStructCreateNamed(ctx->llvm_ctx, name);
+	LLVMTypeRef members[SAFE_COUNT(st->len)];
+	iarreach (i, *st) {
+		members[i] = llvm_type(ctx, st->items[i].type);
+	}
+	LLVMStructSetBody(llvm_st, members, (unsigned)st->len, false);
+	return llvm_st;
+}
 
-		arrpush(ctx->allocator, ctx->struct_types, ((struct type_map_entry){
-			.haste_type = AS_TYPEID(type),
-			.llvm_type = llvm_st,
-		}));
+static LLVMTypeRef llvm_type(struct codegen_context *ctx, struct haste_type type)
+{
+	const TypeID id = AS_TYPEID(type);
+	if (id < ctx->types.len and ctx->types.items[id] != NULL) {
+		return ctx->types.items[id];
+	}
 
-		LLVMTypeRef members[SAFE_COUNT(st->len)];
-		iarreach (i, *st) {
-			members[i] = llvm_type(ctx, st->items[i].type);
-		}
-		LLVMStructSetBody(llvm_st, members, (unsigned)st->len, false);
-		return llvm_st;
+	const uint8_t kind = TYPE_KIND(id);
+	if (kind == HASTE_TY_STRUCT or kind == HASTE_TY_AUTO_STRUCT) {
+		return lower_struct_type(ctx, type);
 	}
 
-	unreachable();
+	LLVMTypeRef llvm_ty = lower_scalar_type(ctx, AS_TYPE_INFO(type));
+	if (llvm_ty == NULL) unreachable();
+	remember_type(ctx, id, llvm_ty);
+	return llvm_ty;
 }
 
-// ── String globals ────────────────────────────────────────────────
+// the builtin scalars and every intN/uintN, so the common lookups never miss
+static void prefill_builtin_types(struct codegen_context *ctx)
+{
+	for (TypeID id = 0; type_is_builtin(into_type(VAL_TYPE(id))); id += 1) {
+		if (HASTE_TID_IS_RESERVED(id) and TYPE_BITS(id) == 0) continue; // no int0
+		LLVMTypeRef llvm_ty = lower_scalar_type(ctx, type_pool_get(id));
+		if (llvm_ty != NULL) remember_type(ctx, id, llvm_ty);
+	}
+}
 
-static uint64_t string_global_counter = 0;
+// ── String globals ────────────────────────────────────────────────
 
 static LLVMValueRef emit_string_global(struct codegen_context *ctx,
                                        const char *data, uint64_t len)
 {
-	char *name = tsprint(".str.{lu}", string_global_counter++);
+	char *name = tsprint(".str.{lu}", ctx->string_count++);
 
 	LLVMValueRef global = LLVMAddGlobal(ctx->module,
 		LLVMArrayType(t_i8(ctx), len + 1), name);
@@ -119,33 +204,165 @@ static LLVMValueRef emit_string_global(struct codegen_context *ctx,
 	return global;
 }
 
+// ── Constant pool ────────────────────────────────────────────────
+//
+// a constant referenced a thousand times is lowered once. strings share
+// one global per content, whatever their string type, since they all
+// lower to the same pointer. structs are keyed by type and members.
+
+#define FNV1A_BASIS 0xcbf29ce484222325ULL
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < len; i += 1) {
+		h = (h ^ bytes[i]) * 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static uint64_t constant_hash(struct haste_value value)
+{
+	if (IS_OBJ(value) and value.obj->kind == HASTE_OBJ_STRING) {
+		const struct haste_string_object *str = (const void*)value.obj;
+		return fnv1a(FNV1A_BASIS, str->data, str->len);
+	}
+
+	uint64_t h = fnv1a(FNV1A_BASIS, &value.type_id, sizeof(value.type_id));
+	if (IS_OBJ(value)) {
+		const struct haste_struct_object *so = (const void*)value.obj;
+		const struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(typeof_value(value));
+		iarreach (i, *st) {
+			const uint64_t member = constant_hash(struct_object_get(so, st, i));
+			h = fnv1a(h, &member, sizeof(member));
+		}
+	} else if (IS_SCALAR(value) and type_is_float(typeof_value(value))) {
+		h = fnv1a(h, &value.floating, sizeof(value.floating));
+	} else if (IS_SCALAR(value)) {
+		h = fnv1a(h, &value.integer, sizeof(value.integer));
+	}
+	return h;
+}
+
+// `value_equal` only knows a struct object by its address
+static bool constant_equal(struct haste_value a, struct haste_value b)
+{
+	const bool a_is_struct = IS_OBJ(a) and a.obj->kind == HASTE_OBJ_STRUCT;
+	const bool b_is_struct = IS_OBJ(b) and b.obj->kind == HASTE_OBJ_STRUCT;
+	if (not a_is_struct or not b_is_struct) {
+		if (IS_OBJ(a) and a.obj->kind == HASTE_OBJ_STRING) return value_equal(a, b);
+		if (a.type_id != b.type_id) return false;
+		// bitwise, so 0.0 and -0.0 stay apart
+		if (IS_SCALAR(a) and IS_SCALAR(b) and type_is_float(typeof_value(a))) {
+			return memcmp(&a.floating, &b.floating, sizeof(a.floating)) == 0;
+		}
+		return value_equal(a, b);
+	}
+	if (a.type_id != b.type_id) return false;
+	if (a.obj == b.obj) return true;
+
+	const struct haste_struct_object *sa = (const void*)a.obj;
+	const struct haste_struct_object *sb = (const void*)b.obj;
+	const struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(typeof_value(a));
+	iarreach (i, *st) {
+		if (not constant_equal(struct_object_get(sa, st, i), struct_object_get(sb, st, i))) return false;
+	}
+	return true;
+}
+
+static struct constant_slot *constant_slot(const struct codegen_context *ctx, struct haste_value value, uint64_t hash)
+{
+	const size_t mask = ctx->constants.cap - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		struct constant_slot *slot = &ctx->constants.items[i];
+		if (slot->llvm == NULL) return slot;
+		if (slot->hash == hash and constant_equal(slot->value, value)) return slot;
+	}
+}
+
+static void constants_grow(struct codegen_context *ctx)
+{
+	const size_t old_cap = ctx->constants.cap;
+	struct constant_slot *old_items = ctx->constants.items;
+	ctx->constants.cap = old_cap then old_cap * 2 otherwise 64;
+	ctx->constants.items = alloc(ctx->allocator, sizeof(struct constant_slot) * ctx->constants.cap);
+	memset(ctx->constants.items, 0, sizeof(struct constant_slot) * ctx->constants.cap);
+
+	for (size_t i = 0; i < old_cap; i += 1) {
+		if (old_items[i].llvm == NULL) continue;
+		*constant_slot(ctx, old_items[i].value, old_items[i].hash) = old_items[i];
+	}
+	if (old_items) xdestroy(ctx->allocator, sizeof(struct constant_slot) * old_cap, old_items);
+}
+
+static LLVMValueRef lower_object(struct codegen_context *ctx, struct haste_value value);
+
+// strings and structs, lowered the first time they are seen
+static LLVMValueRef pooled_constant(struct codegen_context *ctx, struct haste_value value)
+{
+	const uint64_t hash = constant_hash(value);
+	if (ctx->constants.len > 0) {
+		const struct constant_slot *slot = constant_slot(ctx, value, hash);
+		if (slot->llvm != NULL) return slot->llvm;
+	}
+
+	// the members are pooled first, which can grow the table
+	LLVMValueRef llvm = lower_object(ctx, value);
+	if ((ctx->constants.len + 1) * 4 > ctx->constants.cap * 3) {
+		constants_grow(ctx);
+	}
+	*constant_slot(ctx, value, hash) = (struct constant_slot){ .hash = hash, .value = value, .llvm = llvm };
+	ctx->constants.len += 1;
+	return llvm;
+}
+
 // ── Local variable management ─────────────────────────────────────
 
-static struct local_entry push_local(struct codegen_context *ctx, const char *name, LLVMValueRef value, LLVMTypeRef elem_type)
+#define slots_reserve(ctx_, slots_, count_) \
+	do { \
+		const size_t count__ = (count_); \
+		if (count__ <= (slots_).len) break; \
+		while ((slots_).cap < count__) arrgrow((ctx_)->allocator, (slots_)); \
+		memset((slots_).items + (slots_).len, 0, sizeof(*(slots_).items) * (count__ - (slots_).len)); \
+		(slots_).len = count__; \
+	} while (0)
+
+static void set_local(struct codegen_context *ctx, uint32_t slot, LLVMValueRef value)
 {
-	arrpush(ctx->allocator, ctx->locals, ((struct local_entry){ .name = name, .value = value, .elem_type = elem_type }));
-	return ctx->locals.items[ctx->locals.len - 1];
+	assert(slot != 0 and slot < ctx->locals.len);
+	ctx->locals.items[slot] = value;
 }
 
-static struct local_entry find_local_entry(
-	struct codegen_context *ctx,
-	const char *name)
+static void set_global(struct codegen_context *ctx, uint32_t slot, LLVMValueRef value)
 {
-	for (size_t i = ctx->locals.len; i > 0; i--) {
-		if (strcmp(ctx->locals.items[i - 1].name, name) == 0)
-			return ctx->locals.items[i - 1];
+	assert(slot != 0);
+	slots_reserve(ctx, ctx->globals, (size_t)slot + 1);
+	ctx->globals.items[slot] = value;
+}
+
+static void collect_global_decls(struct codegen_context *ctx, const source_file_id src)
+{
+	leach (struct haste_ast_node, node, get_source_file_ast(src)) {
+		uint32_t slot = 0;
+		if (node->kind == ND_VAR_DECL) slot = ((const struct haste_ast_var_decl*)node)->slot;
+		else if (node->kind == ND_FUNC_DECL) slot = ((const struct haste_ast_func_decl*)node)->slot;
+		if (slot == 0) continue;
+		slots_reserve(ctx, ctx->decls, (size_t)slot + 1);
+		ctx->decls.items[slot] = node;
 	}
-	return (struct local_entry){0};
 }
 
-static LLVMValueRef find_local(
-	struct codegen_context *ctx, const char *name)
+// declares the global the first time it is asked for. NULL for the ones
+// that are never emitted, like comptime variables
+static LLVMValueRef get_global(struct codegen_context *ctx, uint32_t slot)
 {
-	for (size_t i = ctx->locals.len; i > 0; i--) {
-		if (strcmp(ctx->locals.items[i - 1].name, name) == 0)
-			return ctx->locals.items[i - 1].value;
+	if (slot < ctx->globals.len and ctx->globals.items[slot] != NULL) {
+		return ctx->globals.items[slot];
 	}
-	return NULL;
+	if (slot >= ctx->decls.len or ctx->decls.items[slot] == NULL) return NULL;
+
+	declare_global_node(ctx, ctx->decls.items[slot]);
+	return slot < ctx->globals.len then ctx->globals.items[slot] otherwise NULL;
 }
 
 // ── Haste value → LLVM value ──────────────────────────────────────
@@ -161,35 +378,22 @@ static LLVMValueRef llvm_value(struct codegen_context *ctx, struct haste_value v
 	case HASTE_VL_SCALAR: {
 		int k = type_pool_get(value.type_id)->kind;
 		if (k == HASTE_TY_USIZE)
-			return LLVMConstInt(t_i64(ctx), value.integer, false);
+			return LLVMConstInt(t_i64(ctx), (unsigned long long)value.integer, false);
 		if (k == HASTE_TY_INT or k == HASTE_TY_UNTYPED_INT or k == HASTE_TY_UINT) {
 			LLVMTypeRef int_type = llvm_type(ctx, typeof_value(value));
-			return LLVMConstInt(int_type, value.integer, k != HASTE_TY_UINT);
+			if (LLVMGetIntTypeWidth(int_type) <= 64) {
+				return LLVMConstInt(int_type, (unsigned long long)value.integer, k != HASTE_TY_UINT);
+			}
+			const haste_uint bits = (haste_uint)value.integer;
+			const uint64_t words[2] = { (uint64_t)bits, (uint64_t)(bits >> 64) };
+			return LLVMConstIntOfArbitraryPrecision(int_type, 2, words);
 		}
 		if (k == HASTE_TY_FLOAT or k == HASTE_TY_UNTYPED_FLOAT)
 			return LLVMConstReal(t_f32(ctx), value.floating);
 		unreachable();
 	}
-	case HASTE_VL_OBJ: {
-		if (value.obj->kind == HASTE_OBJ_STRING) {
-			struct haste_string_object *s = (struct haste_string_object*)value.obj;
-			LLVMValueRef global = emit_string_global(ctx, s->data, s->len);
-			return LLVMConstBitCast(global, t_i8ptr(ctx));
-		}
-
-		if (value.obj->kind == HASTE_OBJ_STRUCT) {
-			LLVMTypeRef llvm_st = llvm_type(ctx, typeof_value(value));
-			struct haste_struct_object *so = (struct haste_struct_object*)value.obj;
-			struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(typeof_value(value));
-			LLVMValueRef members[SAFE_COUNT(st->len)];
-			iarreach (i, *st) {
-				members[i] = llvm_value(ctx, so->fields[i]);
-			}
-			return LLVMConstNamedStruct(llvm_st, members, (unsigned)st->len);
-		}
-
-		unreachable();
-	}
+	case HASTE_VL_OBJ:
+		return pooled_constant(ctx, value);
 	case HASTE_VL_RUNTIME:
 		return codegen_expr(ctx, value.runtime);
 	case HASTE_VL_NONE:
@@ -200,6 +404,28 @@ static LLVMValueRef llvm_value(struct codegen_context *ctx, struct haste_value v
 	}
 }
 
+static LLVMValueRef lower_object(struct codegen_context *ctx, struct haste_value value)
+{
+	if (value.obj->kind == HASTE_OBJ_STRING) {
+		struct haste_string_object *s = (struct haste_string_object*)value.obj;
+		LLVMValueRef global = emit_string_global(ctx, s->data, s->len);
+		return LLVMConstBitCast(global, t_i8ptr(ctx));
+	}
+
+	if (value.obj->kind == HASTE_OBJ_STRUCT) {
+		LLVMTypeRef llvm_st = llvm_type(ctx, typeof_value(value));
+		struct haste_struct_object *so = (struct haste_struct_object*)value.obj;
+		struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(typeof_value(value));
+		LLVMValueRef members[SAFE_COUNT(st->len)];
+		iarreach (i, *st) {
+			members[i] = llvm_value(ctx, struct_object_get(so, st, i));
+		}
+		return LLVMConstNamedStruct(llvm_st, members, (unsigned)st->len);
+	}
+
+	unreachable();
+}
+
 // ── Expression codegen ────────────────────────────────────────────
 
 static LLVMValueRef codegen_cast(struct codegen_context *ctx, const struct haste_ast_cast *node)
@@ -244,8 +470,14 @@ static LLVMValueRef codegen_value(struct codegen_context *ctx, const struct hast
 
 static LLVMValueRef codegen_lvalue(struct codegen_context *ctx, const struct haste_ast_node *node);
 
+// nothing writes to a local or a parameter after its declaration, so they
+// are SSA values. only globals live in memory
 static LLVMValueRef codegen_ident(struct codegen_context *ctx, const struct haste_ast_ident *node)
 {
+	if (not node->is_global) {
+		assert(node->slot < ctx->locals.len and ctx->locals.items[node->slot] != NULL);
+		return ctx->locals.items[node->slot];
+	}
 	LLVMValueRef ptr = codegen_lvalue(ctx, &node->base);
 	return LLVMBuildLoad2(ctx->builder, llvm_type(ctx, node->base.type), ptr, node->value.chars);
 }
@@ -274,10 +506,23 @@ static LLVMValueRef codegen_unary(struct codegen_context *ctx, const struct hast
 	}
 }
 
+// `a.b.c` where `a` is a global. the rest are values, not places
+static bool is_global_place(const struct haste_ast_node *node)
+{
+	while (node->kind == ND_ACCESS) {
+		node = ((const struct haste_ast_access*)node)->lhs;
+	}
+	return node->kind == ND_IDENT and ((const struct haste_ast_ident*)node)->is_global;
+}
+
 static LLVMValueRef codegen_access(struct codegen_context *ctx, const struct haste_ast_access *node)
 {
-	LLVMValueRef ptr = codegen_lvalue(ctx, &node->base);
-	return LLVMBuildLoad2(ctx->builder, llvm_type(ctx, node->base.type), ptr, node->field.chars);
+	if (is_global_place(node->lhs)) {
+		LLVMValueRef ptr = codegen_lvalue(ctx, &node->base);
+		return LLVMBuildLoad2(ctx->builder, llvm_type(ctx, node->base.type), ptr, node->field.chars);
+	}
+	LLVMValueRef aggregate = codegen_expr(ctx, node->lhs);
+	return LLVMBuildExtractValue(ctx->builder, aggregate, (unsigned)node->field_index, node->field.chars);
 }
 
 static LLVMValueRef codegen_lvalue(struct codegen_context *ctx, const struct haste_ast_node *node)
@@ -285,10 +530,8 @@ static LLVMValueRef codegen_lvalue(struct codegen_context *ctx, const struct has
 	switch (node->kind) {
 	case ND_IDENT: {
 		const struct haste_ast_ident *ident = (const void*)node;
-		struct local_entry local = find_local_entry(ctx, ident->value.chars);
-		if (local.name != NULL) return local.value;
-		LLVMValueRef global = LLVMGetNamedGlobal(ctx->module, ident->value.chars);
-		if (global != NULL) return global;
+		LLVMValueRef ptr = ident->is_global then get_global(ctx, ident->slot) otherwise NULL;
+		if (ptr != NULL) return ptr;
 		unreachable();
 	}
 	case ND_ACCESS: {
@@ -305,11 +548,13 @@ static LLVMValueRef codegen_lvalue(struct codegen_context *ctx, const struct has
 static LLVMValueRef codegen_func_call(struct codegen_context *ctx, const struct haste_ast_func_call *node)
 {
 	const char *fn_name = "";
+	LLVMValueRef fn = NULL;
 	if (node->callee->kind == ND_IDENT) {
-		fn_name = ((const struct haste_ast_ident*)node->callee)->value.chars;
+		const struct haste_ast_ident *callee = (const void*)node->callee;
+		fn_name = callee->value.chars;
+		if (callee->is_global) fn = get_global(ctx, callee->slot);
 	}
 
-	LLVMValueRef fn = LLVMGetNamedFunction(ctx->module, fn_name);
 	if (fn == NULL) {
 		fprintf(stderr, "error: function '%s' not found in module\n", fn_name);
 		return LLVMConstInt(t_i32(ctx), 0, true);
@@ -349,6 +594,59 @@ static LLVMValueRef codegen_return(struct codegen_context *ctx, const struct has
 	return LLVMBuildRetVoid(ctx->builder);
 }
 
+static bool block_is_terminated(struct codegen_context *ctx)
+{
+	return LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder)) != NULL;
+}
+
+// a comptime condition was already decided by the analyzer, which never
+// looked at the other branch. so only the taken one is lowered.
+static LLVMValueRef codegen_if(struct codegen_context *ctx, const struct haste_ast_if *node)
+{
+	if (node->cond->kind == ND_VALUE) {
+		const struct haste_value cond = ((const struct haste_ast_value*)node->cond)->value;
+		const struct haste_ast_node *taken = not IS_ZERO(cond) and cond.integer != 0
+			then node->then_branch
+			otherwise node->else_branch;
+		return taken != NULL then codegen_expr(ctx, taken) otherwise NULL;
+	}
+
+	LLVMValueRef cond = codegen_expr(ctx, node->cond);
+	cond = LLVMBuildICmp(ctx->builder, LLVMIntNE, cond, LLVMConstNull(LLVMTypeOf(cond)), "ifcond");
+
+	LLVMBasicBlockRef then_block = LLVMAppendBasicBlockInContext(ctx->llvm_ctx, ctx->current_func, "then");
+	LLVMBasicBlockRef else_block = LLVMAppendBasicBlockInContext(ctx->llvm_ctx, ctx->current_func, "else");
+	LLVMBasicBlockRef merge_block = LLVMAppendBasicBlockInContext(ctx->llvm_ctx, ctx->current_func, "ifend");
+	LLVMBuildCondBr(ctx->builder, cond, then_block, else_block);
+
+	// a branch that ends in `return` doesn't reach the merge block
+	LLVMValueRef values[2];
+	LLVMBasicBlockRef from[2];
+	unsigned incoming = 0;
+	const struct haste_ast_node *branches[2] = { node->then_branch, node->else_branch };
+	LLVMBasicBlockRef blocks[2] = { then_block, else_block };
+	for (size_t i = 0; i < 2; i += 1) {
+		LLVMPositionBuilderAtEnd(ctx->builder, blocks[i]);
+		LLVMValueRef value = branches[i] != NULL then codegen_expr(ctx, branches[i]) otherwise NULL;
+		if (block_is_terminated(ctx)) continue;
+		values[incoming] = value;
+		from[incoming] = LLVMGetInsertBlock(ctx->builder);
+		incoming += 1;
+		LLVMBuildBr(ctx->builder, merge_block);
+	}
+
+	LLVMPositionBuilderAtEnd(ctx->builder, merge_block);
+	if (incoming == 0) {
+		LLVMBuildUnreachable(ctx->builder);
+		return NULL;
+	}
+	if (type_equal(node->base.type, ty_void)) return NULL;
+
+	LLVMValueRef phi = LLVMBuildPhi(ctx->builder, llvm_type(ctx, node->base.type), "iftmp");
+	LLVMAddIncoming(phi, values, from, incoming);
+	return phi;
+}
+
 static LLVMValueRef codegen_expr(struct codegen_context *ctx, const struct haste_ast_node *node)
 {
 	switch (node->kind) {
@@ -362,6 +660,7 @@ static LLVMValueRef codegen_expr(struct codegen_context *ctx, const struct haste
 	case ND_FUNC_CALL: return codegen_func_call(ctx, (void*)node);
 	case ND_BLOCK:     return codegen_block    (ctx, (void*)node);
 	case ND_RETURN:    return codegen_return   (ctx, (void*)node);
+	case ND_IF:        return codegen_if       (ctx, (void*)node);
 	default: unimplemented();
 	}
 }
@@ -386,7 +685,6 @@ static LLVMValueRef codegen_var(struct codegen_context *ctx, const struct haste_
 {
 	if (node->is_explicitly_comptime) return 0;
 
-	const char *name = node->name.chars;
 	LLVMTypeRef type = llvm_type(ctx, node->base.type);
 	LLVMValueRef init = node->value != NULL
 		then codegen_expr(ctx, node->value)
@@ -394,22 +692,20 @@ static LLVMValueRef codegen_var(struct codegen_context *ctx, const struct haste_
 
 	LLVMValueRef symbol = {0};
 	if (is_global) {
-		symbol = LLVMAddGlobal(ctx->module, type, name);
+		symbol = get_global(ctx, node->slot);
 		LLVMSetInitializer(symbol, init);
 		LLVMSetGlobalConstant(symbol, node->is_constant);
 	} else {
-		LLVMValueRef alloca = LLVMBuildAlloca(ctx->builder, type, name);
-		LLVMBuildStore(ctx->builder, init, alloca);
-		struct local_entry local = push_local(ctx, name, alloca, type);
-		symbol = local.value;
+		symbol = init;
+		set_local(ctx, node->slot, symbol);
 	}
 
 	return symbol;
 }
 
-static LLVMValueRef codegen_func_decl(struct codegen_context *ctx, const struct haste_ast_func_decl *node)
+// ret_type(param_types...)
+static LLVMTypeRef function_type(struct codegen_context *ctx, const struct haste_ast_func_decl *node)
 {
-	// Build function type: ret_type(param_types...)
 	LLVMTypeRef return_type = llvm_type(ctx, node->base.type);
 
 	// Count params
@@ -431,38 +727,32 @@ static LLVMValueRef codegen_func_decl(struct codegen_context *ctx, const struct
 		}
 	}
 
-	LLVMTypeRef fn_type = LLVMFunctionType(return_type, param_types, (unsigned)param_count, false);
-	const char *name = node->name.chars;
-	LLVMValueRef fn = LLVMAddFunction(ctx->module, name, fn_type);
+	return LLVMFunctionType(return_type, param_types, (unsigned)param_count, false);
+}
+
+static LLVMValueRef codegen_func_decl(struct codegen_context *ctx, const struct haste_ast_func_decl *node)
+{
+	LLVMValueRef fn = get_global(ctx, node->slot);
+	LLVMTypeRef fn_type = LLVMGlobalGetValueType(fn);
+	LLVMTypeRef return_type = LLVMGetReturnType(fn_type);
 
 	// Create entry basic block
-	LLVMBasicBlockRef entry = LLVMAppendBasicBlock(fn, "entry");
+	LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(ctx->llvm_ctx, fn, "entry");
 	LLVMPositionBuilderAtEnd(ctx->builder, entry);
 
 	// Save current function/restore on exit
 	LLVMValueRef prev_func = ctx->current_func;
 	ctx->current_func = fn;
+	ctx->locals.len = 0;
+	slots_reserve(ctx, ctx->locals, (size_t)node->local_count + 1);
 
-	// Store params in locals (alloca + store)
-	LLVMValueRef llvm_params = LLVMGetParam(fn, 0); // just for typing
-	discard llvm_params;
-	idx = 0;
+	// params are used as they come, see codegen_ident
+	unsigned idx = 0;
 	leach (struct haste_ast_func_param, p, node->params) {
-		struct haste_type param_type = {0};
-		if (p->type != NULL and p->type->kind == ND_VALUE) {
-			struct haste_ast_value *val_node = (struct haste_ast_value*)p->type;
-			param_type = into_type(VAL_TYPE(val_node->value.type));
-		} else if (p->type != NULL) {
-			param_type = p->type->type;
-		}
-		LLVMTypeRef llvm_param_type = llvm_type(ctx, param_type);
 		for (size_t i = 0; i < p->name_count; i++) {
-			const char *pname = p->names[i].chars;
-			LLVMValueRef alloca = LLVMBuildAlloca(ctx->builder, llvm_param_type, pname);
-			LLVMValueRef param_val = LLVMGetParam(fn, (unsigned)idx);
-			LLVMBuildStore(ctx->builder, param_val, alloca);
-			push_local(ctx, pname, alloca, llvm_param_type);
-			idx++;
+			LLVMValueRef param = LLVMGetParam(fn, idx++);
+			LLVMSetValueName2(param, p->names[i].chars, p->names[i].len);
+			set_local(ctx, p->first_slot + (uint32_t)i, param);
 		}
 	}
 
@@ -506,42 +796,755 @@ static Error codegen_global_node(struct codegen_context *ctx, const struct haste
 	return OK;
 }
 
-// ── Entry point ──────────────────────────────────────────────────
+// defining the global later fills in this declaration. one that is never
+// defined here, like another partition's, stays external
+static void declare_global_node(struct codegen_context *ctx, const struct haste_ast_node *node)
+{
+	switch (node->kind) {
+	case ND_VAR_DECL: {
+		const struct haste_ast_var_decl *var = (void*)node;
+		if (var->is_explicitly_comptime) return;
+		set_global(ctx, var->slot, LLVMAddGlobal(ctx->module, llvm_type(ctx, var->base.type), var->name.chars));
+		break;
+	}
+	case ND_FUNC_DECL: {
+		const struct haste_ast_func_decl *fn = (void*)node;
+		set_global(ctx, fn->slot, LLVMAddFunction(ctx->module, fn->name.chars, function_type(ctx, fn)));
+		break;
+	}
+	default: unreachable();
+	}
+}
 
-Error codegen(
-	struct Allocator allocator,
-	const source_file_id src,
-	const char *output_path,
-	bool dump_to_stderr)
+// ── Optimization and emission ────────────────────────────────────
+
+static const char *const pass_pipelines[] = {
+	[OPT_O0] = "default<O0>",
+	[OPT_O1] = "default<O1>",
+	[OPT_O2] = "default<O2>",
+	[OPT_O3] = "default<O3>",
+	[OPT_OS] = "default<Os>",
+};
+
+static LLVMCodeGenOptLevel codegen_opt_level(enum opt_level level)
 {
-	const char *path = get_source_file_path(src);
+	switch (level) {
+	case OPT_O0: return LLVMCodeGenLevelNone;
+	case OPT_O1: return LLVMCodeGenLevelLess;
+	case OPT_O2:
+	case OPT_OS: return LLVMCodeGenLevelDefault;
+	case OPT_O3: return LLVMCodeGenLevelAggressive;
+	}
+	unreachable();
+}
 
-	LLVMContextRef llvm_ctx = LLVMContextCreate();
-	LLVMBuilderRef builder = LLVMCreateBuilder();
-	LLVMModuleRef module = LLVMModuleCreateWithNameInContext(path, llvm_ctx);
+// A machine for the host triple, honoring `-O` and `--target-cpu`. only
+// built when something needs one: writing asm/obj, running passes, a CPU
+// to tune for or the JIT. plain `--llvm` output stays target independent.
+static void init_native_target(void)
+{
+	LLVMInitializeNativeTarget();
+	LLVMInitializeNativeAsmPrinter();
+}
 
-	struct codegen_context ctx = {
-		.llvm_ctx = llvm_ctx,
-		.builder = builder,
-		.module = module,
-		.allocator = allocator,
-	};
+// the partitions of `--jobs` get here from their own threads
+static void ensure_native_target(void)
+{
+	static once_flag native_target_once = ONCE_FLAG_INIT;
+	call_once(&native_target_once, init_native_target);
+}
+
+static bool needs_target_machine(enum emit_kind emit)
+{
+	return emit == EMIT_ASM or emit == EMIT_OBJ
+		or g_options.opt_level != OPT_O0 or g_options.target_cpu != NULL;
+}
+
+static LLVMTargetMachineRef create_target_machine(void)
+{
+	ensure_native_target();
+
+	char *triple = LLVMGetDefaultTargetTriple();
+	char *err_msg = NULL;
+	LLVMTargetRef target = NULL;
+	if (LLVMGetTargetFromTriple(triple, &target, &err_msg)) {
+		eprintln("error: no target for '{s}': {s}", triple, err_msg);
+		LLVMDisposeMessage(err_msg);
+		LLVMDisposeMessage(triple);
+		return NULL;
+	}
+
+	const char *cpu = "generic";
+	const char *features = "";
+	char *host_cpu = NULL, *host_features = NULL;
+	if (g_options.target_cpu != NULL and strcmp(g_options.target_cpu, "native") == 0) {
+		cpu = host_cpu = LLVMGetHostCPUName();
+		features = host_features = LLVMGetHostCPUFeatures();
+	} else if (g_options.target_cpu != NULL) {
+		cpu = g_options.target_cpu;
+	}
+
+	LLVMTargetMachineRef machine = LLVMCreateTargetMachine(
+		target, triple, cpu, features,
+		codegen_opt_level(g_options.opt_level),
+		LLVMRelocPIC, LLVMCodeModelDefault);
+
+	if (host_cpu) LLVMDisposeMessage(host_cpu);
+	if (host_features) LLVMDisposeMessage(host_features);
+	LLVMDisposeMessage(triple);
+	return machine;
+}
+
+// LLVM has no way to ask whether it knows a CPU. an unknown name only gets
+// "is not a recognized processor" written to stderr when a machine is
+// made, and later aborts the emitter. so one machine is made here, on the
+// main thread before any other starts, with stderr caught in a pipe
+bool codegen_knows_cpu(const char *cpu)
+{
+	if (strcmp(cpu, "native") == 0) return true;
+
+	ensure_native_target();
+
+	char *triple = LLVMGetDefaultTargetTriple();
+	LLVMTargetRef target = NULL;
+	char *err_msg = NULL;
+	if (LLVMGetTargetFromTriple(triple, &target, &err_msg)) {
+		// create_target_machine() reports this one
+		LLVMDisposeMessage(err_msg);
+		LLVMDisposeMessage(triple);
+		return true;
+	}
+
+	int fds[2];
+	const int saved_stderr = dup(2);
+	if (saved_stderr < 0 or pipe(fds) != 0) {
+		if (saved_stderr >= 0) close(saved_stderr);
+		LLVMDisposeMessage(triple);
+		return true;
+	}
+	sflush(serr);
+	fflush(stderr);
+	dup2(fds[1], 2);
+	close(fds[1]);
+
+	LLVMTargetMachineRef machine = LLVMCreateTargetMachine(
+		target, triple, cpu, "", LLVMCodeGenLevelNone, LLVMRelocDefault, LLVMCodeModelDefault);
+	LLVMDisposeTargetMachine(machine);
+	LLVMDisposeMessage(triple);
+
+	dup2(saved_stderr, 2);
+	close(saved_stderr);
+
+	char output[1024];
+	size_t len = 0;
+	for (int n; (n = (int)read(fds[0], output + len, sizeof(output) - 1 - len)) > 0;) {
+		len += (size_t)n;
+	}
+	close(fds[0]);
+	output[len] = '\0';
+	return strstr(output, "is not a recognized processor") == NULL;
+}
+
+static void target_module(LLVMModuleRef module, LLVMTargetMachineRef machine)
+{
+	char *triple = LLVMGetTargetMachineTriple(machine);
+	LLVMSetTarget(module, triple);
+	LLVMDisposeMessage(triple);
+
+	LLVMTargetDataRef layout = LLVMCreateTargetDataLayout(machine);
+	LLVMSetModuleDataLayout(module, layout);
+	LLVMDisposeTargetData(layout);
+}
+
+// LLVM trusts its input: invalid IR reaching the passes, the machine code
+// emitter or the JIT crashes instead of failing. so every module is checked
+// before it goes anywhere
+static Error verify_module(LLVMModuleRef module)
+{
+	char *msg = NULL;
+	if (LLVMVerifyModule(module, LLVMReturnStatusAction, &msg)) {
+		eprintln("error: codegen produced an invalid module, this is a compiler bug:\n{s}", msg);
+		LLVMDisposeMessage(msg);
+		return ERROR;
+	}
+	LLVMDisposeMessage(msg);
+	return OK;
+}
+
+static Error run_pass_pipeline(LLVMModuleRef module, LLVMTargetMachineRef machine)
+{
+	if (g_options.opt_level == OPT_O0) return OK;
+
+	LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+	LLVMErrorRef err = LLVMRunPasses(module, pass_pipelines[g_options.opt_level], machine, options);
+	LLVMDisposePassBuilderOptions(options);
+	if (err != NULL) {
+		char *msg = LLVMGetErrorMessage(err);
+		eprintln("error: the optimization pipeline failed: {s}", msg);
+		LLVMDisposeErrorMessage(msg);
+		return ERROR;
+	}
+	return OK;
+}
+
+static Error write_buffer(LLVMMemoryBufferRef buffer, stream_t out)
+{
+	swrite(out, (const unsigned char*)LLVMGetBufferStart(buffer), 1, LLVMGetBufferSize(buffer));
+	sflush(out);
+	LLVMDisposeMemoryBuffer(buffer);
+	return OK;
+}
+
+// `output_path` NULL writes to stderr
+static Error emit_module(LLVMModuleRef module, LLVMTargetMachineRef machine, enum emit_kind emit, const char *output_path)
+{
+	char *err_msg = NULL;
+	switch (emit) {
+	case EMIT_NONE:
+		return OK;
+	case EMIT_LL:
+		if (output_path == NULL) {
+			LLVMDumpModule(module);
+			return OK;
+		}
+		if (LLVMPrintModuleToFile(module, output_path, &err_msg)) break;
+		return OK;
+	case EMIT_BC:
+		if (output_path == NULL) return write_buffer(LLVMWriteBitcodeToMemoryBuffer(module), serr);
+		if (LLVMWriteBitcodeToFile(module, output_path) == 0) return OK;
+		eprintln("error: failed to write bitcode to '{s}'.", output_path);
+		return ERROR;
+	case EMIT_ASM:
+	case EMIT_OBJ: {
+		const LLVMCodeGenFileType file_type = emit == EMIT_ASM then LLVMAssemblyFile otherwise LLVMObjectFile;
+		if (output_path == NULL) {
+			LLVMMemoryBufferRef buffer = NULL;
+			if (LLVMTargetMachineEmitToMemoryBuffer(machine, module, file_type, &err_msg, &buffer)) break;
+			return write_buffer(buffer, serr);
+		}
+		if (LLVMTargetMachineEmitToFile(machine, module, (char*)output_path, file_type, &err_msg)) break;
+		return OK;
+	}
+	}
+
+	eprintln("error: failed to write '{s}': {s}", output_path then output_path otherwise "<stderr>", err_msg);
+	LLVMDisposeMessage(err_msg);
+	return ERROR;
+}
 
+// targets, optimizes and writes a whole module. `output_path` NULL writes to stderr
+static Error emit_lowered_module(LLVMModuleRef module, enum emit_kind emit, const char *output_path)
+{
+	if (emit == EMIT_NONE) return OK;
+
+	Error err = verify_module(module);
+	LLVMTargetMachineRef machine = NULL;
+	if (not err and needs_target_machine(emit)) {
+		machine = create_target_machine();
+		if (machine == NULL) err = ERROR;
+		else target_module(module, machine);
+	}
+	if (not err) err = run_pass_pipeline(module, machine);
+	if (not err) err = emit_module(module, machine, emit, output_path);
+
+	if (machine) LLVMDisposeTargetMachine(machine);
+	return err;
+}
+
+// ── JIT ──────────────────────────────────────────────────────────
+
+// `int __haste_run(int argc, char **argv)`, so the host calls one C
+// signature whatever `main` takes and returns. `main` gets argc if it
+// takes an integer, and its integer result becomes the exit status.
+static void emit_run_entry(struct codegen_context *ctx, LLVMValueRef main_fn)
+{
+	LLVMTypeRef params[] = { t_i32(ctx), LLVMPointerType(t_i8ptr(ctx), 0) };
+	LLVMValueRef entry = LLVMAddFunction(ctx->module, "__haste_run", LLVMFunctionType(t_i32(ctx), params, 2, false));
+	LLVMPositionBuilderAtEnd(ctx->builder, LLVMAppendBasicBlockInContext(ctx->llvm_ctx, entry, "entry"));
+
+	LLVMTypeRef main_type = LLVMGlobalGetValueType(main_fn);
+	const unsigned argc = LLVMCountParamTypes(main_type);
+	LLVMValueRef args[1];
+	if (argc == 1) {
+		LLVMTypeRef argc_type;
+		LLVMGetParamTypes(main_type, &argc_type);
+		args[0] = LLVMBuildIntCast2(ctx->builder, LLVMGetParam(entry, 0), argc_type, true, "argc");
+	}
+
+	LLVMValueRef result = LLVMBuildCall2(ctx->builder, main_type, main_fn, args, argc, "");
+	if (LLVMGetTypeKind(LLVMGetReturnType(main_type)) == LLVMIntegerTypeKind) {
+		LLVMBuildRet(ctx->builder, LLVMBuildIntCast2(ctx->builder, result, t_i32(ctx), true, "status"));
+	} else {
+		LLVMBuildRet(ctx->builder, LLVMConstInt(t_i32(ctx), 0, false));
+	}
+}
+
+static LLVMValueRef runnable_main(struct codegen_context *ctx, const source_file_id src)
+{
+	const struct haste_ast_func_decl *decl = NULL;
 	leach (struct haste_ast_node, node, get_source_file_ast(src)) {
-		codegen_global_node(&ctx, node);
+		if (node->kind != ND_FUNC_DECL or not node->analyzed) continue;
+		if (strcmp(((const struct haste_ast_func_decl*)node)->name.chars, "main") == 0) {
+			decl = (const void*)node;
+		}
+	}
+	LLVMValueRef main_fn = decl then get_global(ctx, decl->slot) otherwise NULL;
+	if (main_fn == NULL) {
+		eprintln("error: '{s}' has no 'main' function to run.", get_source_file_path(src));
+		return NULL;
 	}
 
-	if (dump_to_stderr) {
-		LLVMDumpModule(ctx.module);
-	} else if (output_path) {
-		char *err_msg = NULL;
-		if (LLVMPrintModuleToFile(ctx.module, output_path, &err_msg)) {
-			fprintf(stderr, "error: failed to write LLVM IR to '%s': %s\n", output_path, err_msg);
+	LLVMTypeRef main_type = LLVMGlobalGetValueType(main_fn);
+	const LLVMTypeKind ret = LLVMGetTypeKind(LLVMGetReturnType(main_type));
+	const unsigned argc = LLVMCountParamTypes(main_type);
+	LLVMTypeRef param = NULL;
+	if (argc == 1) LLVMGetParamTypes(main_type, &param);
+
+	if ((ret != LLVMIntegerTypeKind and ret != LLVMVoidTypeKind)
+		or argc > 1 or (param and LLVMGetTypeKind(param) != LLVMIntegerTypeKind)) {
+		eprintln("error: 'main' must take nothing or one integer (the argument count), and return an integer or nothing.");
+		return NULL;
+	}
+	return main_fn;
+}
+
+static Error report_llvm_error(const char *what, LLVMErrorRef err)
+{
+	char *msg = LLVMGetErrorMessage(err);
+	eprintln("error: {s}: {s}", what, msg);
+	LLVMDisposeErrorMessage(msg);
+	return ERROR;
+}
+
+static LLVMOrcLLJITRef create_jit(void)
+{
+	LLVMTargetMachineRef machine = create_target_machine();
+	if (machine == NULL) return NULL;
+
+	// the JIT compiles with the same CPU and level as `--emit` would
+	LLVMOrcLLJITBuilderRef builder = LLVMOrcCreateLLJITBuilder();
+	LLVMOrcLLJITBuilderSetJITTargetMachineBuilder(builder, LLVMOrcJITTargetMachineBuilderCreateFromTargetMachine(machine));
+
+	LLVMOrcLLJITRef jit = NULL;
+	LLVMErrorRef err = LLVMOrcCreateLLJIT(&jit, builder);
+	if (err) {
+		report_llvm_error("could not create the JIT", err);
+		return NULL;
+	}
+
+	// programs can call into the C library the compiler itself links
+	LLVMOrcDefinitionGeneratorRef process = NULL;
+	err = LLVMOrcCreateDynamicLibrarySearchGeneratorForProcess(&process, LLVMOrcLLJITGetGlobalPrefix(jit), NULL, NULL);
+	if (err) {
+		report_llvm_error("could not expose the process symbols to the JIT", err);
+		LLVMOrcDisposeLLJIT(jit);
+		return NULL;
+	}
+	LLVMOrcJITDylibAddGenerator(LLVMOrcLLJITGetMainJITDylib(jit), process);
+	return jit;
+}
+
+// the unoptimized bitcode, plus everything about the machine that changes
+// the code it produces
+static uint64_t module_cache_key(LLVMModuleRef module, LLVMTargetMachineRef machine)
+{
+	uint64_t h = FNV1A_BASIS;
+
+	LLVMMemoryBufferRef bitcode = LLVMWriteBitcodeToMemoryBuffer(module);
+	h = fnv1a(h, LLVMGetBufferStart(bitcode), LLVMGetBufferSize(bitcode));
+	LLVMDisposeMemoryBuffer(bitcode);
+
+	char *cpu = LLVMGetTargetMachineCPU(machine);
+	char *features = LLVMGetTargetMachineFeatureString(machine);
+	h = fnv1a(h, cpu, strlen(cpu) + 1);
+	h = fnv1a(h, features, strlen(features) + 1);
+	h = fnv1a(h, &g_options.opt_level, sizeof(g_options.opt_level));
+	LLVMDisposeMessage(cpu);
+	LLVMDisposeMessage(features);
+	return h;
+}
+
+// `mkdir -p`. false if `path` is not a directory afterwards
+static bool ensure_directory(const char *path)
+{
+	char *dir = tsprint("{s}", path);
+	for (char *c = dir + 1; *c; c += 1) {
+		if (*c != '/' and *c != '\\') continue;
+		const char sep = *c;
+		*c = '\0';
+		if (make_directory(dir) != 0 and errno != EEXIST) return false;
+		*c = sep;
+	}
+	if (make_directory(dir) != 0 and errno != EEXIST) return false;
+
+	struct stat st;
+	return stat(dir, &st) == 0 and (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+static void store_cached_object(const char *path, LLVMMemoryBufferRef object)
+{
+	// written next to the final name and renamed, so a reader never sees half a file
+	char *tmp_path = tsprint("{s}.tmp", path);
+	FILE *file = fopen(tmp_path, "wb");
+	bool ok = file != NULL;
+	if (ok) {
+		ok = fwrite(LLVMGetBufferStart(object), 1, LLVMGetBufferSize(object), file) == LLVMGetBufferSize(object);
+		ok = fclose(file) == 0 and ok;
+	}
+	if (ok) ok = rename(tmp_path, path) == 0;
+	if (not ok) {
+		remove(tmp_path);
+		eprintln("warning: could not write the JIT cache entry '{s}'.", path);
+	}
+}
+
+// with `--jit-cache`, the object for this module comes from the cache when
+// an earlier run left one. otherwise the optimized module is compiled once
+// into the cache and that object is what runs
+static Error add_cached_object(LLVMOrcLLJITRef jit, LLVMModuleRef module, LLVMTargetMachineRef machine)
+{
+	if (not ensure_directory(g_options.jit_cache)) {
+		eprintln("error: could not create the JIT cache directory '{s}'.", g_options.jit_cache);
+		return ERROR;
+	}
+	const char *path = tsprint("{s}/{lu}.o", g_options.jit_cache, (unsigned long)module_cache_key(module, machine));
+	LLVMMemoryBufferRef object = NULL;
+	char *err_msg = NULL;
+
+	if (LLVMCreateMemoryBufferWithContentsOfFile(path, &object, &err_msg)) {
+		LLVMDisposeMessage(err_msg);
+		if (run_pass_pipeline(module, machine)) return ERROR;
+		if (LLVMTargetMachineEmitToMemoryBuffer(machine, module, LLVMObjectFile, &err_msg, &object)) {
+			eprintln("error: could not compile the module: {s}", err_msg);
 			LLVMDisposeMessage(err_msg);
-			context_deinit(&ctx);
 			return ERROR;
 		}
+		store_cached_object(path, object);
 	}
-	context_deinit(&ctx);
+
+	LLVMErrorRef err = LLVMOrcLLJITAddObjectFile(jit, LLVMOrcLLJITGetMainJITDylib(jit), object);
+	if (err) return report_llvm_error("could not load the compiled module", err);
 	return OK;
 }
+
+static Error add_module(LLVMOrcLLJITRef jit, struct codegen_context *ctx, LLVMOrcThreadSafeContextRef tsc, LLVMTargetMachineRef machine)
+{
+	if (run_pass_pipeline(ctx->module, machine)) return ERROR;
+
+	LLVMOrcThreadSafeModuleRef tsm = LLVMOrcCreateNewThreadSafeModule(ctx->module, tsc);
+	ctx->module = NULL; // the JIT owns it now
+	LLVMErrorRef err = LLVMOrcLLJITAddLLVMIRModule(jit, LLVMOrcLLJITGetMainJITDylib(jit), tsm);
+	if (err) return report_llvm_error("could not add the module to the JIT", err);
+	return OK;
+}
+
+// ── Parallel codegen ─────────────────────────────────────────────
+//
+// `--jobs=<n>` splits the analyzed declarations in n partitions by the hash
+// of their name, so a program always splits the same way. each partition is
+// lowered and optimized on its own thread, in its own LLVM context. the
+// globals it uses but does not define are left as external declarations. the main thread links
+// the partitions' bitcode, in partition order, into one module.
+
+struct codegen_partition {
+	source_file_id src;
+	struct Allocator allocator;
+	enum emit_kind emit;
+	uint32_t index, count;
+	thrd_t thread;
+	LLVMMemoryBufferRef bitcode; // NULL if the partition failed
+};
+
+static uint32_t partition_of(const struct haste_ast_node *node, uint32_t count)
+{
+	const struct string name = node->kind == ND_FUNC_DECL
+		then ((const struct haste_ast_func_decl*)node)->name
+		otherwise ((const struct haste_ast_var_decl*)node)->name;
+	return (uint32_t)(fnv1a(FNV1A_BASIS, name.chars, name.len) % count);
+}
+
+static int lower_partition(void *data)
+{
+	struct codegen_partition *part = data;
+	struct codegen_context ctx = context_init(part->allocator, LLVMContextCreate(), true, get_source_file_path(part->src));
+	prefill_builtin_types(&ctx);
+
+	collect_global_decls(&ctx, part->src);
+	leach (struct haste_ast_node, node, get_source_file_ast(part->src)) {
+		if (not node->analyzed or partition_of(node, part->count) != part->index) continue;
+		codegen_global_node(&ctx, node);
+	}
+
+	LLVMTargetMachineRef machine = NULL;
+	Error err = verify_module(ctx.module);
+	if (not err and needs_target_machine(part->emit)) {
+		machine = create_target_machine();
+		if (machine == NULL) err = ERROR;
+		else target_module(ctx.module, machine);
+	}
+	if (not err) err = run_pass_pipeline(ctx.module, machine);
+	if (not err) part->bitcode = LLVMWriteBitcodeToMemoryBuffer(ctx.module);
+
+	if (machine) LLVMDisposeTargetMachine(machine);
+	context_deinit(&ctx);
+	free_temporary_allocator();
+	return 0;
+}
+
+// links every partition into the first one. NULL if any of them failed
+static LLVMModuleRef link_partitions(LLVMContextRef llvm_ctx, struct codegen_partition *parts, uint32_t count)
+{
+	LLVMModuleRef module = NULL;
+	bool failed = false;
+	for (uint32_t i = 0; i < count; i += 1) {
+		if (parts[i].bitcode == NULL) {
+			failed = true;
+			continue;
+		}
+		LLVMModuleRef part = NULL;
+		if (not failed and LLVMParseBitcodeInContext2(llvm_ctx, parts[i].bitcode, &part)) {
+			eprintln("error: could not read back codegen partition {d}.", (int)i);
+			failed = true;
+		}
+		LLVMDisposeMemoryBuffer(parts[i].bitcode);
+		if (failed) continue;
+
+		if (module == NULL) {
+			module = part;
+		} else if (LLVMLinkModules2(module, part)) {
+			eprintln("error: could not link codegen partition {d}.", (int)i);
+			failed = true;
+		}
+	}
+	if (failed and module) {
+		LLVMDisposeModule(module);
+		module = NULL;
+	}
+	return module;
+}
+
+static Error codegen_partitioned(struct Allocator allocator, const source_file_id src, enum emit_kind emit, const char *output_path)
+{
+	const uint32_t count = (uint32_t)g_options.codegen_jobs;
+	struct codegen_partition parts[CODEGEN_MAX_JOBS] = {0};
+
+	Error err = OK;
+	uint32_t started = 0;
+	for (; started < count; started += 1) {
+		parts[started] = (struct codegen_partition){
+			.src = src,
+			.allocator = allocator,
+			.emit = emit,
+			.index = started,
+			.count = count,
+		};
+		if (thrd_create(&parts[started].thread, lower_partition, &parts[started]) != thrd_success) {
+			eprintln("error: could not start a codegen thread.");
+			err = ERROR;
+			break;
+		}
+	}
+	for (uint32_t i = 0; i < started; i += 1) {
+		thrd_join(parts[i].thread, NULL);
+	}
+
+	LLVMContextRef llvm_ctx = LLVMContextCreate();
+	LLVMModuleRef module = link_partitions(llvm_ctx, parts, started);
+	if (module == NULL) err = ERROR;
+
+	// the partitions are optimized already. only writing machine code needs one here
+	LLVMTargetMachineRef machine = NULL;
+	if (not err and (emit == EMIT_ASM or emit == EMIT_OBJ)) {
+		machine = create_target_machine();
+		if (machine == NULL) err = ERROR;
+	}
+	if (not err) err = emit_module(module, machine, emit, output_path);
+
+	if (machine) LLVMDisposeTargetMachine(machine);
+	if (module) LLVMDisposeModule(module);
+	LLVMContextDispose(llvm_ctx);
+	return err;
+}
+
+// ── Pipelined codegen ────────────────────────────────────────────
+//
+// `--pipeline` lowers each top-level declaration as soon as analysis
+// finishes it. the analyzer pushes finished declarations into a bounded
+// queue and one codegen thread drains it, so analysis of the next
+// declaration overlaps the lowering of the last one. the thread starts with
+// the first declaration, once analysis has given every global its slot.
+
+#define STREAM_QUEUE_CAP 64
+
+struct codegen_stream {
+	struct codegen_context ctx;
+	source_file_id src;
+	thrd_t thread;
+	bool started, closed;
+	bool failed; // the thread could not start
+	mtx_t lock;
+	cnd_t not_empty, not_full;
+	uint32_t head, len;
+	struct haste_ast_node *queue[STREAM_QUEUE_CAP];
+};
+
+static int stream_worker(void *data)
+{
+	struct codegen_stream *stream = data;
+	for (;;) {
+		mtx_lock(&stream->lock);
+		while (stream->len == 0 and not stream->closed) {
+			cnd_wait(&stream->not_empty, &stream->lock);
+		}
+		if (stream->len == 0) {
+			mtx_unlock(&stream->lock);
+			break;
+		}
+		struct haste_ast_node *node = stream->queue[stream->head];
+		stream->head = (stream->head + 1) % STREAM_QUEUE_CAP;
+		stream->len -= 1;
+		cnd_signal(&stream->not_full);
+		mtx_unlock(&stream->lock);
+
+		codegen_global_node(&stream->ctx, node);
+		// nothing reads a lowered declaration's tree again
+		free_declaration_tree(node);
+	}
+	free_temporary_allocator();
+	return 0;
+}
+
+static void stream_push(void *data, struct haste_ast_node *decl)
+{
+	struct codegen_stream *stream = data;
+	if (not stream->started) {
+		stream->started = true;
+		collect_global_decls(&stream->ctx, stream->src);
+		if (thrd_create(&stream->thread, stream_worker, stream) != thrd_success) {
+			eprintln("error: could not start the codegen thread.");
+			stream->failed = true;
+		}
+	}
+	if (stream->failed) return;
+
+	mtx_lock(&stream->lock);
+	while (stream->len == STREAM_QUEUE_CAP) {
+		cnd_wait(&stream->not_full, &stream->lock);
+	}
+	stream->queue[(stream->head + stream->len) % STREAM_QUEUE_CAP] = decl;
+	stream->len += 1;
+	cnd_signal(&stream->not_empty);
+	mtx_unlock(&stream->lock);
+}
+
+struct codegen_stream *codegen_stream_begin(struct Allocator allocator, const source_file_id src)
+{
+	struct codegen_stream *stream = create(allocator, struct codegen_stream,
+		.ctx = context_init(allocator, LLVMContextCreate(), true, get_source_file_path(src)),
+		.src = src);
+	prefill_builtin_types(&stream->ctx);
+	mtx_init(&stream->lock, mtx_plain);
+	cnd_init(&stream->not_empty);
+	cnd_init(&stream->not_full);
+	return stream;
+}
+
+struct declaration_sink codegen_stream_sink(struct codegen_stream *stream)
+{
+	return (struct declaration_sink){ .ctx = stream, .done = stream_push };
+}
+
+Error codegen_stream_finish(struct codegen_stream *stream, enum emit_kind emit, const char *output_path, bool dump_to_stderr)
+{
+	mtx_lock(&stream->lock);
+	stream->closed = true;
+	cnd_signal(&stream->not_empty);
+	mtx_unlock(&stream->lock);
+	if (stream->started and not stream->failed) thrd_join(stream->thread, NULL);
+
+	Error err = stream->failed then ERROR
+		otherwise emit_lowered_module(stream->ctx.module, emit, dump_to_stderr then NULL otherwise output_path);
+
+	cnd_destroy(&stream->not_full);
+	cnd_destroy(&stream->not_empty);
+	mtx_destroy(&stream->lock);
+	struct Allocator allocator = stream->ctx.allocator;
+	context_deinit(&stream->ctx);
+	xdestroy(allocator, sizeof(*stream), stream);
+	return err;
+}
+
+// ── Entry point ──────────────────────────────────────────────────
+
+static struct codegen_context lower_source(struct Allocator allocator, LLVMContextRef llvm_ctx, bool owns_llvm_ctx, const source_file_id src)
+{
+	struct codegen_context ctx = context_init(allocator, llvm_ctx, owns_llvm_ctx, get_source_file_path(src));
+	prefill_builtin_types(&ctx);
+	collect_global_decls(&ctx, src);
+
+	leach (struct haste_ast_node, node, get_source_file_ast(src)) {
+		// not reachable from `main`. see `entry_point()` in analysis.c
+		if (not node->analyzed) continue;
+		codegen_global_node(&ctx, node);
+	}
+	return ctx;
+}
+
+Error codegen(
+	struct Allocator allocator,
+	const source_file_id src,
+	enum emit_kind emit,
+	const char *output_path,
+	bool dump_to_stderr)
+{
+	if (g_options.codegen_jobs > 1 and emit != EMIT_NONE and (dump_to_stderr or output_path)) {
+		return codegen_partitioned(allocator, src, emit, dump_to_stderr then NULL otherwise output_path);
+	}
+
+	struct codegen_context ctx = lower_source(allocator, LLVMContextCreate(), true, src);
+	Error err = OK;
+	if (dump_to_stderr or output_path) {
+		err = emit_lowered_module(ctx.module, emit, dump_to_stderr then NULL otherwise output_path);
+	}
+	context_deinit(&ctx);
+	return err;
+}
+
+Error codegen_run(struct Allocator allocator, const source_file_id src, int *exit_status)
+{
+	LLVMOrcThreadSafeContextRef tsc = LLVMOrcCreateNewThreadSafeContext();
+	struct codegen_context ctx = lower_source(allocator, LLVMOrcThreadSafeContextGetContext(tsc), false, src);
+
+	Error err = OK;
+	LLVMTargetMachineRef machine = NULL;
+	LLVMOrcLLJITRef jit = NULL;
+
+	LLVMValueRef main_fn = runnable_main(&ctx, src);
+	if (main_fn == NULL) { err = ERROR; goto done; }
+	emit_run_entry(&ctx, main_fn);
+	if (verify_module(ctx.module)) { err = ERROR; goto done; }
+
+	machine = create_target_machine();
+	jit = create_jit();
+	if (machine == NULL or jit == NULL) { err = ERROR; goto done; }
+	target_module(ctx.module, machine);
+
+	err = g_options.jit_cache
+		then add_cached_object(jit, ctx.module, machine)
+		otherwise add_module(jit, &ctx, tsc, machine);
+	if (err) goto done;
+
+	LLVMOrcExecutorAddress address = 0;
+	LLVMErrorRef lookup_err = LLVMOrcLLJITLookup(jit, &address, "__haste_run");
+	if (lookup_err) { err = report_llvm_error("could not find the program's entry", lookup_err); goto done; }
+
+	int (*run)(int, char **) = (int (*)(int, char **))(uintptr_t)address;
+	*exit_status = run(g_options.program_argc, (char **)g_options.program_argv);
+
+done:
+	context_deinit(&ctx);
+	if (jit) LLVMOrcDisposeLLJIT(jit);
+	if (machine) LLVMDisposeTargetMachine(machine);
+	LLVMOrcDisposeThreadSafeContext(tsc);
+	return err;
+}
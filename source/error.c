@@ -10,101 +10,251 @@ static void error(const char *fmt, ...)
 	Exit(1);
 }
 
-static struct string get_full_line(const char *content, struct string span)
-{
-	struct string result = span;
+// ── Diagnostics buffer ───────────────────────────────────────────
+//
+// Reports are not written when they happen. each one is recorded (with its
+// message already formatted) and `flush_diagnostics()` sorts them by
+// location, drops duplicates, applies `--max-errors` and writes them all
+// at once. a note belongs to the error or warning reported right before it
+// and moves with it.
 
-	while (result.chars > content and result.chars[-1] != '\n') {
-		result.chars -= 1;
-	}
+struct text_buffer {
+	size_t len, cap;
+	char *items;
+};
+
+struct diagnostic {
+	enum diagnostic_severity severity;
+	source_file_id src;
+	uint32_t offset;
+	uint32_t seq;           // report order, breaks ties between equal locations
+	uint32_t note_count;    // notes right after this record that belong to it
+	uint32_t message_start; // into `text`
+	uint32_t message_len;
+};
 
-	while (result.chars[result.len] != '\0' and result.chars[result.len] != '\n') {
-		result.len += 1;
+static struct {
+	struct { size_t len, cap; struct diagnostic *items; } records;
+	struct text_buffer text;
+	size_t error_count;
+	bool flushing;
+} diagnostics = {0};
+
+static void text_buffer_reserve(struct text_buffer *buf, size_t amount)
+{
+	while (buf->len + amount > buf->cap) {
+		arrgrow(default_allocator, *buf);
 	}
+}
+
+static int text_buffer_write(void *data, const unsigned char *in, size_t count)
+{
+	struct text_buffer *buf = data;
+	text_buffer_reserve(buf, count);
+	memcpy(buf->items + buf->len, in, count);
+	buf->len += count;
+	return (int)count;
+}
+
+static int text_buffer_close(void *data) { discard data; return 0; }
+static int text_buffer_flush(void *data) { discard data; return 0; }
+static int text_buffer_seek(void *data, long int offset, int whence) { discard data; discard offset; discard whence; return -1; }
+static int text_buffer_read(void *data, unsigned char *out, size_t amount) { discard data; discard out; discard amount; return 0; }
+
+static const stream_interface_t text_buffer_vtable = {
+	.close = text_buffer_close,
+	.read  = text_buffer_read,
+	.write = text_buffer_write,
+	.seek  = text_buffer_seek,
+	.flush = text_buffer_flush,
+};
 
-	return result;
+#define text_buffer_stream(buf_) ((stream_t){ .data = (buf_), .vtable = &text_buffer_vtable })
+
+static const char *severity_label(enum diagnostic_severity severity)
+{
+	switch (severity) {
+	case DIAG_ERROR:   return ANSI_CODE_RED    "Error";
+	case DIAG_WARNING: return ANSI_CODE_YELLOW "Warning";
+	case DIAG_NOTE:    return ANSI_CODE_GREEN  "Note";
+	}
+	unreachable();
 }
 
-static int get_line_number(const char *content, const char *pos)
+static void record_diagnostic(source_file_id src, enum diagnostic_severity severity, const char *start, const char *fmt, va_list args)
 {
-	int line = 1;
-	for (const char *cur = pos; cur > content; cur -= 1) {
-		if (*cur == '\n') {
-			line += 1;
+	const char *content = get_source_file_content(src);
+	const size_t message_start = diagnostics.text.len;
+	vsprint(text_buffer_stream(&diagnostics.text), fmt, args);
+
+	if (severity == DIAG_NOTE) {
+		// a note without an error or warning before it stands on its own
+		for (size_t i = diagnostics.records.len; i > 0; i -= 1) {
+			struct diagnostic *owner = &diagnostics.records.items[i - 1];
+			if (owner->severity == DIAG_NOTE) continue;
+			owner->note_count += 1;
+			break;
 		}
+	} else if (severity == DIAG_ERROR) {
+		diagnostics.error_count += 1;
 	}
 
-	return line;
+	arrpush(default_allocator, diagnostics.records, ((struct diagnostic){
+		.severity = severity,
+		.src = src,
+		.offset = (uint32_t)(start - content),
+		.seq = (uint32_t)diagnostics.records.len,
+		.message_start = (uint32_t)message_start,
+		.message_len = (uint32_t)(diagnostics.text.len - message_start),
+	}));
 }
 
-static int get_column_number(source_file_id src, const char *content, const char *pos)
+bool diagnostics_limit_reached(void)
 {
-	const char *line_start = pos;
-	while (line_start > content and line_start[-1] != '\n') {
-		line_start -= 1;
-	}
-	return display_width(line_start, (int)(pos - line_start), src) + 1;
+	return g_options.max_errors != 0 and diagnostics.error_count >= g_options.max_errors;
 }
 
-static void report_at_with_src(source_file_id src, const char *kind, const char *start, const char *fmt, va_list args)
+// ── Rendering ────────────────────────────────────────────────────
+
+// `d` is a copy: display_width() reports bad UTF-8, which can move the records
+static void render_diagnostic(stream_t out, const struct diagnostic d)
 {
-	const char *content = get_source_file_content(src);
-	const int line_no = get_line_number(content, start);
-	const int column_no = get_column_number(src, content, start);
-	const struct string line = string_to_trimed(get_full_line(content, string(start, 0)));
+	const char *content = get_source_file_content(d.src);
+	const char *start = content + d.offset;
+	const struct source_line source_line = get_source_line(d.src, d.offset);
+	const char *line_start = content + source_line.start;
 
-	const char *path = get_source_file_path(src);
-	eprint(ANSI_CODE_BOLD ANSI_CODE_UNDERLINE "{s}:{d}:{d}" ANSI_CODE_RESET ": " ANSI_CODE_BOLD "{s}: " ANSI_CODE_RESET, path, line_no, column_no, kind);
-	vsprint(serr, fmt, args);
-	eprint("\n");
+	const int line_no = (int)source_line.number;
+	const int column_no = display_width(line_start, (int)(start - line_start), d.src) + 1;
+	const struct string line = string_to_trimed(string(line_start, source_line.end - source_line.start));
+	const struct string message = string(diagnostics.text.items + d.message_start, d.message_len);
 
-	int indent = eprint("{d:w5} | ", line_no);
-	eprintln("{string}", line);
-	int pos = display_width(line.chars, (int)((uintptr_t)start - (uintptr_t)line.chars), src) + indent;
+	const char *path = get_source_file_path(d.src);
+	sprint(out, ANSI_CODE_BOLD ANSI_CODE_UNDERLINE "{s}:{d}:{d}" ANSI_CODE_RESET ": " ANSI_CODE_BOLD "{s}: " ANSI_CODE_RESET, path, line_no, column_no, severity_label(d.severity));
+	sprintln(out, "{string}", message);
 
-	eprint("{s:w*}^ ", "", pos, pos);
-	eprint("\n");
+	int indent = sprint(out, "{d:w5} | ", line_no);
+	sprintln(out, "{string}", line);
+	int pos = display_width(line.chars, (int)((uintptr_t)start - (uintptr_t)line.chars), d.src) + indent;
+
+	sprint(out, "{s:w*}^ ", "", pos, pos);
+	sprint(out, "\n");
+}
+
+static bool same_diagnostic(const struct diagnostic *a, const struct diagnostic *b)
+{
+	return a->severity == b->severity
+		and a->src == b->src
+		and a->offset == b->offset
+		and a->message_len == b->message_len
+		and memcmp(diagnostics.text.items + a->message_start,
+		           diagnostics.text.items + b->message_start, a->message_len) == 0;
+}
+
+static int compare_groups(const void *lhs, const void *rhs)
+{
+	const struct diagnostic *a = &diagnostics.records.items[*(const uint32_t*)lhs];
+	const struct diagnostic *b = &diagnostics.records.items[*(const uint32_t*)rhs];
+	if (a->src != b->src)       return a->src < b->src then -1 otherwise 1;
+	if (a->offset != b->offset) return a->offset < b->offset then -1 otherwise 1;
+	return a->seq < b->seq then -1 otherwise (a->seq > b->seq);
+}
+
+void flush_diagnostics(void)
+{
+	// rendering decodes UTF-8, which can report too. those are kept for the
+	// next flush instead of being mixed into this one
+	if (diagnostics.flushing or diagnostics.records.len == 0) return;
+	diagnostics.flushing = true;
+
+	const size_t count = diagnostics.records.len;
+	struct { size_t len, cap; uint32_t *items; } groups = {0};
+	for (size_t i = 0; i < count; i += 1 + diagnostics.records.items[i].note_count) {
+		arrpush(default_allocator, groups, (uint32_t)i);
+	}
+	qsort(groups.items, groups.len, sizeof(*groups.items), compare_groups);
+
+	struct text_buffer out = {0};
+	stream_t stream = text_buffer_stream(&out);
+	size_t errors_shown = 0;
+	bool truncated = false;
+
+	// indices, not pointers. rendering may grow the records
+	iarreach (g, groups) {
+		const uint32_t head = groups.items[g];
+		const struct diagnostic *records = diagnostics.records.items;
+		if (g > 0 and same_diagnostic(&records[groups.items[g - 1]], &records[head])) continue;
+
+		if (records[head].severity == DIAG_ERROR) {
+			if (g_options.max_errors != 0 and errors_shown == g_options.max_errors) {
+				truncated = true;
+				continue;
+			}
+			errors_shown += 1;
+		}
+		const uint32_t note_count = records[head].note_count;
+		for (uint32_t i = 0; i <= note_count; i += 1) {
+			render_diagnostic(stream, diagnostics.records.items[head + i]);
+		}
+	}
+	if (truncated or diagnostics_limit_reached()) {
+		sprintln(stream, ANSI_CODE_BOLD "stopped after {z} errors." ANSI_CODE_RESET, errors_shown);
+	}
+
+	swrite(serr, (const unsigned char*)out.items, 1, out.len);
+	sflush(serr);
+	arrfree(default_allocator, out);
+	arrfree(default_allocator, groups);
+
+	// keep whatever was reported while rendering
+	const size_t late = diagnostics.records.len - count;
+	memmove(diagnostics.records.items, diagnostics.records.items + count, late * sizeof(*diagnostics.records.items));
+	diagnostics.records.len = late;
+	if (late == 0) diagnostics.text.len = 0;
+	diagnostics.flushing = false;
 }
 
-void f_report_at(const source_file_id src, const char *kind, const char *start, const char *fmt, ...)
+// ── Reporting ────────────────────────────────────────────────────
+
+void f_report_at(const source_file_id src, enum diagnostic_severity severity, const char *start, const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	report_at_with_src(src, kind, start, fmt, args);
+	record_diagnostic(src, severity, start, fmt, args);
 	va_end(args);
 }
 
-void f_vreport_at(const source_file_id src, const char *kind, const char *start, const char *fmt, va_list args)
+void f_vreport_at(const source_file_id src, enum diagnostic_severity severity, const char *start, const char *fmt, va_list args)
 {
-	report_at_with_src(src, kind, start, fmt, args);
+	record_diagnostic(src, severity, start, fmt, args);
 }
 
-void f_report_at_token(const char *kind, struct token token, const char *fmt, ...)
+void f_report_at_token(enum diagnostic_severity severity, struct token token, const char *fmt, ...)
 {
 	const char *content = get_source_file_content(token.src);
 	va_list args;
 	va_start(args, fmt);
-	report_at_with_src(token.src, kind, content + token.start, fmt, args);
+	record_diagnostic(token.src, severity, content + token.start, fmt, args);
 	va_end(args);
 }
 
-void f_vreport_at_token(const char *kind, struct token token, const char *fmt, va_list args)
+void f_vreport_at_token(enum diagnostic_severity severity, struct token token, const char *fmt, va_list args)
 {
 	const char *content = get_source_file_content(token.src);
-	report_at_with_src(token.src, kind, content + token.start, fmt, args);
+	record_diagnostic(token.src, severity, content + token.start, fmt, args);
 }
 
-void f_report_at_location(const char *kind, struct location location, const char *fmt, ...)
+void f_report_at_location(enum diagnostic_severity severity, struct location location, const char *fmt, ...)
 {
 	const char *content = get_source_file_content(location.src);
 	va_list args;
 	va_start(args, fmt);
-	report_at_with_src(location.src, kind, content + location.start, fmt, args);
+	record_diagnostic(location.src, severity, content + location.start, fmt, args);
 	va_end(args);
 }
 
-void f_vreport_at_location(const char *kind, struct location location, const char *fmt, va_list args)
+void f_vreport_at_location(enum diagnostic_severity severity, struct location location, const char *fmt, va_list args)
 {
 	const char *content = get_source_file_content(location.src);
-	report_at_with_src(location.src, kind, content + location.start, fmt, args);
+	record_diagnostic(location.src, severity, content + location.start, fmt, args);
 }
@@ -14,7 +14,15 @@
 #include <stdint.h>
 
 #define SAFE_COUNT(n) ((n) > 0 ? (n) : (size_t)1)
+
+// comptime integers are as wide as the widest intN/uintN. aligned(8) keeps
+// haste_value at 24 bytes
+__extension__ typedef __int128 haste_int __attribute__((aligned(8)));
+__extension__ typedef unsigned __int128 haste_uint __attribute__((aligned(8)));
+#define HASTE_INT_MAX ((haste_int)(~(haste_uint)0 >> 1))
+#define HASTE_INT_MIN (-HASTE_INT_MAX - 1)
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdnoreturn.h>
 
 #ifdef _MSC_VER
@@ -49,6 +57,39 @@ typedef enum Error {
 //
 // options.c
 //
+/**
+  * Limits on compile-time evaluation. 0 means no limit. `g_options` has
+  * one that applies to every declaration on its own and one for the whole
+  * analysis.
+  */
+struct comptime_budget {
+	uint64_t steps;
+	uint64_t bytes; // allocated by the analyzer while evaluating
+	uint64_t ms;
+};
+
+#define DEFAULT_COMPTIME_STEPS 100000000ULL
+#define DEFAULT_COMPTIME_BYTES (1ULL << 30)
+
+#define CODEGEN_MAX_JOBS 64
+
+// what codegen writes. `--llvm` alone means EMIT_LL
+enum emit_kind {
+	EMIT_NONE,
+	EMIT_LL,  // textual IR
+	EMIT_BC,  // bitcode
+	EMIT_ASM, // assembly for the target
+	EMIT_OBJ, // object file for the target
+};
+
+enum opt_level {
+	OPT_O0,
+	OPT_O1,
+	OPT_O2,
+	OPT_O3,
+	OPT_OS,
+};
+
 struct options {
 	bool dump_tokens : 1;
 	bool dump_ast    : 1;
@@ -58,6 +99,25 @@ struct options {
 	bool do_dump     : 1;
 	bool disable_fun : 1;
 	bool only_parse  : 1;
+	bool no_comptime_vm : 1;
+	bool check_all   : 1;
+	size_t max_errors; // 0 means no limit
+	struct comptime_budget decl_budget;
+	struct comptime_budget total_budget;
+	enum emit_kind emit;
+	enum opt_level opt_level;
+	size_t codegen_jobs; // threads lowering the module. 1 keeps it on the main one
+	bool pipeline;       // lower declarations while analysis goes on
+	// `haste run`: JIT the program and call its `main` with these
+	bool run;
+	int program_argc;
+	const char **program_argv; // [0] is the source path
+	const char *jit_cache;     // directory of compiled objects, NULL for none
+	// `--incremental`: the files after the source, analyzed as its next edits
+	bool incremental;
+	int edit_count;
+	const char **edit_paths;
+	const char *target_cpu; // NULL for a generic CPU. "native" is the host's
 	const char *source_path;
 	const char *output_path;
 };
@@ -82,6 +142,14 @@ struct source_file {
 	size_t len;
 	enum source_file_type type;
 	struct haste_ast_node *root; // NULL by default
+	// where every line starts. built by the first `get_source_line()`
+	struct { size_t len, cap; uint32_t *items; } line_starts;
+};
+
+struct source_line {
+	uint32_t number; // 1-based
+	uint32_t start;  // offset of the first byte of the line
+	uint32_t end;    // offset of its '\n' (or the end of the file)
 };
 
 struct source_file_list {
@@ -145,6 +213,12 @@ const char *get_source_file_content(const source_file_id id);
   */
 const char *get_source_file_end(const source_file_id id);
 
+/**
+  * @brief given an id and an offset into its content. it will return the line containing it.
+  * @brief the first call indexes where every line starts, the rest are a binary search.
+  */
+struct source_line get_source_line(const source_file_id id, uint32_t offset);
+
 /**
   * @brief given an id. it will return which type is that file
   */
@@ -222,7 +296,7 @@ struct token {
 	enum token_kind kind : 8;
 
 	union {
-		int64_t ival;
+		haste_int ival;
 		double fval;
 		const char *str;
 		const char *ident;
@@ -261,6 +335,8 @@ struct token_stream {
 };
 
 struct token_stream token_stream(source_file_id src);
+// starts lexing at `offset`, which must be where a token starts
+struct token_stream token_stream_at(source_file_id src, uint32_t offset);
 
 bool token_stream_ended(const struct token_stream *stream);
 struct token token_stream_peek(struct token_stream *stream);
@@ -346,13 +422,34 @@ const char *intern_cstr(const char *str);
 typedef uint32_t TypeID;
 struct haste_type_info;
 
+// The pool only ever appends. an id is reserved with one atomic add, its
+// chunk is allocated once and never moves, so a `haste_type_info*` stays
+// valid for the rest of the compilation and reading a type takes no lock.
+// a slot is ready once `type_pool_add` returns its id to the creator, the
+// other threads get ids only through values the creator publishes.
+#define TY_POOL_CHUNK      256
+#define TY_POOL_MAX_CHUNKS 4096
+
+struct type_pool_chunk {
+	// the fields the predicates read, copied out of haste_type_info so they
+	// sit next to each other. see TYPE_KIND and TYPE_FLAGS
+	uint8_t kinds[TY_POOL_CHUNK];
+	uint8_t flags[TY_POOL_CHUNK];
+	uint16_t bits[TY_POOL_CHUNK];
+	struct haste_type_info *infos; // TY_POOL_CHUNK of them
+};
+
 struct type_pool {
 	struct Allocator allocator;
+	_Atomic uint32_t len;
+	_Atomic(struct type_pool_chunk *) chunks[TY_POOL_MAX_CHUNKS];
+	// structural types, hash-consed by type_pool_intern. the only part of
+	// the pool that is written under a lock
+	atomic_flag interned_lock;
 	struct {
 		size_t len, cap;
-		struct haste_type_info **items;
-	} chunks;
-	uint32_t len;
+		struct type_intern_slot { uint64_t hash; TypeID id; } *items;
+	} interned;
 };
 
 #define STANDARD_BITWIDTH_LIMIT       128
@@ -361,11 +458,47 @@ struct type_pool {
 #define HASTE_TID_TOTAL_RESERVED      ( HASTE_TID_RESERVED_UINT_BASE + 129 )
 #define HASTE_TID_IS_RESERVED(id)     ((id) <= HASTE_TID_TOTAL_RESERVED)
 
+// setup_builtins adds these right after the reserved ids, in this order,
+// so the ty_* handles are known at compile time
+enum {
+	HASTE_TID_TYPE = HASTE_TID_TOTAL_RESERVED + 1,
+	HASTE_TID_ZERO,
+	HASTE_TID_UNKNOWN,
+	HASTE_TID_UNTYPED_INT,
+	HASTE_TID_FLOAT,
+	HASTE_TID_UNTYPED_FLOAT,
+	HASTE_TID_AUTO,
+	HASTE_TID_VOID,
+	HASTE_TID_UNTYPED_STRING,
+	HASTE_TID_CSTR,
+	HASTE_TID_USIZE,
+	HASTE_TID_STRING,
+};
+
+enum {
+	TYPE_FLAG_INTEGER  = 1 << 0,
+	TYPE_FLAG_FLOAT    = 1 << 1,
+	TYPE_FLAG_UNSIGNED = 1 << 2,
+	TYPE_FLAG_STRING   = 1 << 3,
+	TYPE_FLAG_UNTYPED  = 1 << 4,
+};
+
 extern struct type_pool g_type_pool;
 
+#define TYPE_POOL_CHUNK_OF(id) \
+	(atomic_load_explicit(&g_type_pool.chunks[(id) / TY_POOL_CHUNK], memory_order_acquire))
+
+#define TYPE_KIND(id)      ((TYPE_POOL_CHUNK_OF(id)->kinds[(id) % TY_POOL_CHUNK]))
+#define TYPE_FLAGS(id)     ((TYPE_POOL_CHUNK_OF(id)->flags[(id) % TY_POOL_CHUNK]))
+#define TYPE_BITS(id)      ((TYPE_POOL_CHUNK_OF(id)->bits[(id) % TY_POOL_CHUNK]))
+// an integer type without an explicit width (the untyped ones) holds 128 bits
+#define TYPE_INT_BITS(id)  ((TYPE_BITS(id) then TYPE_BITS(id) otherwise STANDARD_BITWIDTH_LIMIT))
+
 TypeID type_pool_add(struct haste_type_info type);
+TypeID type_pool_intern(struct haste_type_info type, bool *existed);
 struct haste_type_info *type_pool_get(TypeID id);
-void type_pool_set_name(TypeID id, const char *name);
+// ids below this are reserved. types other threads are still filling in can be among them
+TypeID type_pool_len(void);
 struct haste_value type_get_int(uint16_t bits, bool is_signed);
 
 //
@@ -396,8 +529,8 @@ struct haste_value type_get_int(uint16_t bits, bool is_signed);
 #  define IS_TYPE(...)              ((__VA_ARGS__).kind == HASTE_VL_TYPE)
 #  define IS_LVALUE(...)            ((__VA_ARGS__).is_lvalue)
 
-#  define IS_STRUCT_TYPE(...)       ((AS_TYPE_INFO(__VA_ARGS__)->kind == HASTE_TY_STRUCT))
-#  define IS_AUTO_STRUCT_TYPE(...)  ((AS_TYPE_INFO(__VA_ARGS__)->kind == HASTE_TY_AUTO_STRUCT))
+#  define IS_STRUCT_TYPE(...)       ((TYPE_KIND(AS_TYPEID(__VA_ARGS__)) == HASTE_TY_STRUCT))
+#  define IS_AUTO_STRUCT_TYPE(...)  ((TYPE_KIND(AS_TYPEID(__VA_ARGS__)) == HASTE_TY_AUTO_STRUCT))
 
 #  define IS_OBJ(...)               ((__VA_ARGS__).kind == HASTE_VL_OBJ)
 #  define IS_STRUCT(...)            ((IS_OBJ(__VA_ARGS__)) and ((__VA_ARGS__).obj->kind == HASTE_OBJ_STRUCT))
@@ -434,6 +567,15 @@ enum haste_value_error {
 	/* STRUCTS */
 	ERR_NOT_A_STRUCT,
 	ERR_FIELD_DOESNT_EXIST,
+
+	/* COMPTIME */
+	ERR_CALL_DEPTH_EXCEEDED,
+	ERR_COMPTIME_STEPS, // the step budget ran out. see `struct comptime_budget`
+	ERR_COMPTIME_TIME,  // so did the time budget
+	ERR_COMPTIME_BYTES, // or the memory budget
+
+	/* INTEGERS */
+	ERR_INT_OUT_OF_RANGE,
 };
 
 enum haste_value_kind {
@@ -455,7 +597,7 @@ struct haste_value {
 
 	union {
 		enum haste_value_error error_code;
-		int64_t integer;
+		haste_int integer;
 		double floating;
 		TypeID type;
 		struct haste_ast_node *runtime;
@@ -468,6 +610,8 @@ struct haste_object {
 		HASTE_OBJ_STRING,
 		HASTE_OBJ_STRUCT,
 	} kind : 8;
+	// shared objects are immutable, writers copy them first
+	bool is_shared : 1;
 };
 
 struct haste_string_object {
@@ -476,11 +620,29 @@ struct haste_string_object {
 	char data[];
 };
 
+// the payload of a haste_value, without its kind and type
+union haste_payload {
+	enum haste_value_error error_code;
+	haste_int integer;
+	double floating;
+	TypeID type;
+	struct haste_ast_node *runtime;
+	struct haste_object *obj;
+};
+
+// Fields are stored as `len` payloads followed by `len` tag bytes (the
+// value kind and its flags). The type of a field comes from the struct
+// type, so use struct_object_get/struct_object_put to read and write them.
 struct haste_struct_object {
 	struct haste_object base;
-	struct haste_value fields[];
+	uint32_t len;
+	union haste_payload data[];
 };
 
+#define STRUCT_OBJECT_SIZE(n_) \
+	(sizeof(struct haste_struct_object) + (sizeof(union haste_payload) + 1) * SAFE_COUNT(n_))
+#define STRUCT_OBJECT_TAGS(so_) ((uint8_t *)((so_)->data + (so_)->len))
+
 // TODO: Move the type pool away from value.c
 
 struct haste_type;
@@ -531,6 +693,7 @@ struct haste_value struct_set_field_by_index(struct Allocator,
 
 bool haste_is_default_empty_string(const struct haste_object *obj);
 
+int print_haste_int(stream_t stream, haste_int value, bool is_unsigned);
 int print_object(stream_t stream, const struct haste_object *obj, struct haste_type type);
 int print_value(stream_t stream, const struct haste_value value);
 
@@ -544,20 +707,20 @@ struct haste_type {
 	struct haste_value value;
 };
 
-extern struct haste_type ty_zero;
-extern struct haste_type ty_unknown;
-extern struct haste_type ty_type;
-extern struct haste_type ty_uint;
-extern struct haste_type ty_int;
-extern struct haste_type ty_untyped_int;
-extern struct haste_type ty_float;
-extern struct haste_type ty_untyped_float;
-extern struct haste_type ty_auto;
-extern struct haste_type ty_void;
-extern struct haste_type ty_untyped_string;
-extern struct haste_type ty_string;
-extern struct haste_type ty_cstr;
-extern struct haste_type ty_usize;
+extern const struct haste_type ty_zero;
+extern const struct haste_type ty_unknown;
+extern const struct haste_type ty_type;
+extern const struct haste_type ty_uint;
+extern const struct haste_type ty_int;
+extern const struct haste_type ty_untyped_int;
+extern const struct haste_type ty_float;
+extern const struct haste_type ty_untyped_float;
+extern const struct haste_type ty_auto;
+extern const struct haste_type ty_void;
+extern const struct haste_type ty_untyped_string;
+extern const struct haste_type ty_string;
+extern const struct haste_type ty_cstr;
+extern const struct haste_type ty_usize;
 
 struct haste_type_info {
 	TypeID pool_id;
@@ -599,6 +762,15 @@ struct haste_type_info {
 				struct haste_value default_value;
 				bool has_default;
 			} *items;
+			// name -> field index, see struct_type_index_fields()
+			uint32_t index_cap;
+			uint32_t *index;
+			// shared instances, see struct_type_build_shared(): the fields
+			// as a literal starts them, then with every field defaulted or
+			// zeroed (NULL when some field has no default)
+			struct haste_struct_object *shared_initial;
+			struct haste_struct_object *shared_default;
+			struct haste_struct_object *shared_zero;
 		} structure;
 	};
 };
@@ -610,15 +782,21 @@ struct haste_type into_type(struct haste_value value);
 struct haste_value into_value(struct haste_type type);
 
 bool type_is_builtin(struct haste_type ty);
-bool is_newly_created_type(struct haste_type ty);
-void reset_new_type_counter(void);
 
 ssize_t find_named_field(const struct haste_type tp, const char *name);
+ssize_t struct_field_index(const struct haste_struct_type_info *st, const char *name);
+/** @brief interns the field names and builds the lookup index. call it once, before the type is added to the pool */
+void struct_type_index_fields(struct Allocator alloc, struct haste_struct_type_info *st);
+/** @brief builds the shared initial/default/zero instances. call it once, after struct_type_index_fields */
+void struct_type_build_shared(struct Allocator alloc, struct haste_struct_type_info *st);
 
 struct haste_type typeof_value(const struct haste_value value);
 
 struct haste_value   make_value(struct Allocator alloc, const struct haste_type type);
 struct haste_object *create_struct(struct Allocator alloc, struct haste_struct_type_info *st);
+struct haste_struct_object *alloc_struct_object(struct Allocator alloc, size_t field_count);
+struct haste_value struct_object_get(const struct haste_struct_object *so, const struct haste_struct_type_info *st, size_t idx);
+void struct_object_put(struct haste_struct_object *so, const struct haste_struct_type_info *st, size_t idx, struct haste_value value);
 struct haste_object *create_string(struct Allocator alloc, const char *str, size_t len);
 
 /** @brief These are the allowed cast:
@@ -636,8 +814,8 @@ struct haste_object *create_string(struct Allocator alloc, const char *str, size
 struct haste_value value_cast(struct Allocator alloc, const struct haste_type to, const struct haste_value value);
 struct haste_value value_implicit_cast(struct Allocator alloc, const struct haste_type to, const struct haste_value value);
 struct haste_value value_coerce(struct Allocator alloc, const struct haste_type to, const struct haste_value value);
-struct haste_value zero_for_type(struct Allocator alloc, struct haste_type to);
-struct haste_value default_for_type(struct Allocator alloc, struct haste_type to);
+struct haste_value zero_for_type(struct haste_type to);
+struct haste_value default_for_type(struct haste_type to);
 
 bool type_equal(const struct haste_type t1,
                 const struct haste_type t2);
@@ -650,9 +828,15 @@ bool type_is_untyped_float(const struct haste_type t);
 bool type_is_number(const struct haste_type t);
 bool type_is_untyped(const struct haste_type t);
 bool type_is_untyped_integer(const struct haste_type t);
+
+// width and signedness of an integer type. untyped integers are int128
+uint16_t int_type_bits(const struct haste_type_info *info);
+bool int_fits(haste_int value, uint16_t bits, bool is_unsigned);
+haste_int int_wrap(haste_int value, uint16_t bits, bool is_unsigned);
 bool type_is_untyped_number(const struct haste_type t);
 bool type_is_any_string(const struct haste_type t);
 
+uint64_t type_info_hash(const struct haste_type_info *ot);
 uint64_t type_hash(const struct haste_type t);
 
 //
@@ -704,6 +888,7 @@ enum haste_ast_node_kind {
 	ND_FUNC_CALL_ARG,
 	ND_BLOCK,
 	ND_RETURN,
+	ND_IF,
 };
 
 struct haste_ast_node {
@@ -721,7 +906,7 @@ struct haste_ast_value { // ND_VALUE
 
 struct haste_ast_integer_lit { // ND_INTEGER_LIT
 	struct haste_ast_node base;
-	int64_t value;
+	haste_int value;
 };
 
 struct haste_ast_float_lit { // ND_FLOAT_LIT
@@ -737,6 +922,10 @@ struct haste_ast_string_lit { // ND_STRING_LIT
 struct haste_ast_ident { // ND_IDENT
 	struct haste_ast_node base;
 	struct string value;
+	// what the name resolved to, for codegen: the slot of a local in its
+	// function, or the handle of a global declaration. 0 when unresolved
+	uint32_t slot;
+	bool is_global;
 };
 
 struct haste_ast_int_bits { // ND_INT_BITS
@@ -825,6 +1014,13 @@ struct haste_ast_var_decl { // ND_VAR_DECL
 	struct location name_loc;
 	struct haste_ast_node *type;
 	struct haste_ast_node *value;
+	uint32_t slot; // see haste_ast_ident
+	// owns `type` and `value` when they were parsed on demand, see
+	// parse_declaration_tree() and free_declaration_tree()
+	struct Arena *tree_arena;
+	// `type` and `value` are not parsed yet, see parse_declaration_tree().
+	// not a bitfield: the codegen thread reads the flags next to it
+	bool tree_pending;
 };
 
 struct haste_ast_func_param { // ND_FUNC_PARAM
@@ -834,6 +1030,7 @@ struct haste_ast_func_param { // ND_FUNC_PARAM
 	struct location *name_locs;
 	struct haste_ast_node *type;
 	struct haste_ast_func_param *next;
+	uint32_t first_slot; // names[i] lives in slot first_slot + i
 };
 
 struct haste_ast_func_decl { // ND_FUNC_DECL
@@ -843,6 +1040,8 @@ struct haste_ast_func_decl { // ND_FUNC_DECL
 	struct haste_ast_func_param *params;
 	struct haste_ast_node *return_type;
 	struct haste_ast_node *body;
+	uint32_t slot;        // its global handle, see haste_ast_ident
+	uint32_t local_count; // slots 1..local_count are its params and locals
 };
 
 struct haste_ast_func_call_arg { // ND_FUNC_CALL_ARG
@@ -867,32 +1066,260 @@ struct haste_ast_return { // ND_RETURN
 	struct haste_ast_node *value;
 };
 
+// `if cond then ... else ... end`. the branches are blocks, `else if` nests
+// another ND_IF as the else branch (sharing its `end`).
+struct haste_ast_if { // ND_IF
+	struct haste_ast_node base;
+	struct haste_ast_node *cond;
+	struct haste_ast_node *then_branch;
+	struct haste_ast_node *else_branch; // NULL without `else`
+};
+
 void *node_into_value(
 	struct Allocator allocator,
 	void *nd,
 	struct haste_value value);
 int print_haste_ast(stream_t file, const struct haste_ast_node *root);
 bool node_is_declaration(const struct haste_ast_node *node);
+/** @brief frees the tree of a declaration parsed into its own arena. the node itself stays, without `type` and `value` */
+void free_declaration_tree(struct haste_ast_node *decl);
+
+/**
+  * @brief structural hash of `node` and its children (not its `next` siblings).
+  * @brief locations are not part of the hash. so moving code around keeps it stable.
+  */
+uint64_t ast_hash(const struct haste_ast_node *node);
 
 //
 // error.c
 //
-void f_report_at(const source_file_id src, const char *kind, const char *start, const char *fmt, ...);
-void f_vreport_at(const source_file_id src, const char *kind, const char *start, const char *fmt, va_list args);
-void f_report_at_token(const char *kind, struct token token, const char *fmt, ...);
-void f_vreport_at_token(const char *kind, struct token token, const char *fmt, va_list args);
-void f_report_at_location(const char *kind, struct location location, const char *fmt, ...);
-void f_vreport_at_location(const char *kind, struct location location, const char *fmt, va_list args);
+enum diagnostic_severity {
+	DIAG_ERROR,
+	DIAG_WARNING,
+	DIAG_NOTE, // attached to the error or warning reported before it
+};
+
+// these record the report. nothing is printed until `flush_diagnostics()`
+void f_report_at(const source_file_id src, enum diagnostic_severity severity, const char *start, const char *fmt, ...);
+void f_vreport_at(const source_file_id src, enum diagnostic_severity severity, const char *start, const char *fmt, va_list args);
+void f_report_at_token(enum diagnostic_severity severity, struct token token, const char *fmt, ...);
+void f_vreport_at_token(enum diagnostic_severity severity, struct token token, const char *fmt, va_list args);
+void f_report_at_location(enum diagnostic_severity severity, struct location location, const char *fmt, ...);
+void f_vreport_at_location(enum diagnostic_severity severity, struct location location, const char *fmt, va_list args);
+
+// sorts the recorded reports by location, drops duplicates and writes them to stderr
+void flush_diagnostics(void);
+// true once `--max-errors` errors were reported. long phases should stop early
+bool diagnostics_limit_reached(void);
 
 //
 // parse.c
 //
-Error parse(struct Allocator allocator, const source_file_id src);
+// with `arena_per_declaration` every top-level constant and variable is
+// only checked, its tree is parsed on demand into an arena of its own by
+// parse_declaration_tree(), and freed once it is lowered
+Error parse(struct Allocator allocator, const source_file_id src, bool arena_per_declaration);
+void parse_declaration_tree(struct haste_ast_node *node);
+
+//
+// vm.c
+//
+
+/**
+  * Register bytecode for compile-time evaluation. A register is a raw int128
+  * or double. which one is known while compiling, so the opcodes are typed
+  * and the interpreter never touches a `haste_value`.
+  */
+enum vm_op : uint8_t {
+	VM_LOADK,        // r[dst] = k[a]
+	VM_MOVE,         // r[dst] = r[a]
+	VM_ADD_INT,      // r[dst] = r[a] + r[b]. overflow checked like `value_add()`
+	VM_SUB_INT,
+	VM_MUL_INT,
+	VM_DIV_INT,
+	VM_ADD_FLOAT,
+	VM_SUB_FLOAT,
+	VM_MUL_FLOAT,
+	VM_DIV_FLOAT,
+	VM_NEG_INT,      // r[dst] = -r[a]
+	VM_NEG_FLOAT,
+	VM_INT_TO_FLOAT, // r[dst] = (double)r[a]
+	VM_FLOAT_TO_INT, // r[dst] = (haste_int)r[a]
+	VM_CHECK_OVERFLOW, // overflow unless r[dst] fits in an `a` bit int, unsigned when b != 0
+	VM_CHECK_RANGE,  // same check for implicit conversions
+	VM_WRAP_INT,     // r[dst] = r[dst] truncated to an `a` bit int, unsigned when b != 0
+	VM_CALL,         // r[dst] = callees[a](r[b], ..., r[b + argc - 1])
+	VM_RET,          // return r[a]
+	VM_JUMP,         // pc = a
+	VM_JUMP_IF_ZERO, // pc = a when r[dst] == 0
+};
+
+union vm_reg {
+	haste_int integer;
+	double floating;
+};
+
+struct vm_instr {
+	enum vm_op op;
+	uint8_t argc;
+	uint32_t dst, a, b;
+};
+
+struct vm_chunk {
+	struct { size_t cap, len; struct vm_instr *items; } code;
+	struct { size_t cap, len; struct location *items; } locs; // one per instruction
+	struct { size_t cap, len; union vm_reg *items; } constants;
+	struct { size_t cap, len; struct vm_function **items; } callees;
+	uint32_t reg_count;
+};
+
+struct vm_function {
+	const struct haste_ast_func_decl *decl;
+	struct vm_chunk chunk;
+	size_t param_count;
+	TypeID *param_types;
+	TypeID return_type;
+	enum {
+		VM_FN_COMPILING,
+		VM_FN_READY,
+		VM_FN_UNSUPPORTED,
+	} state : 8;
+};
+
+/**
+  * How the compiler sees the rest of the program. every callback can say no,
+  * then the expression is left to the tree-walking evaluator.
+  */
+struct vm_resolver {
+	void *ctx;
+	// the comptime-known value `ident` refers to.
+	bool (*lookup)(void *ctx, const struct haste_ast_ident *ident, struct haste_value *out);
+	// the type a type expression denotes (like the target of a cast).
+	bool (*type_of)(void *ctx, struct haste_ast_node *node, struct haste_type *out);
+	// the analyzed function `callee` names. `from_global` when it appears in
+	// a function body, since those names don't see the current scope.
+	// can be NULL to never compile calls.
+	const struct haste_ast_func_decl *(*function_of)(void *ctx, const struct haste_ast_node *callee, bool from_global);
+};
+
+struct vm {
+	struct Allocator allocator;
+	struct vm_resolver resolver;
+	// reused by `vm_eval()`. unless it gets called again while compiling
+	struct vm_chunk scratch;
+	bool scratch_in_use;
+	struct { size_t cap, len; struct vm_function **items; } functions;
+	struct { size_t cap, len; union vm_reg *items; } registers;
+	struct { size_t cap, len; struct vm_frame {
+		const struct vm_chunk *chunk;
+		const struct vm_function *fn; // NULL for `vm_eval()` expressions
+		uint64_t args_hash;
+		size_t pc;
+		size_t base;
+		uint32_t ret; // caller register that receives the result
+	} *items; } frames;
+
+	/**
+	  * Results of finished calls keyed by (function, argument registers).
+	  * compiled functions can't have side effects, so a result never goes
+	  * stale. open addressing, `cap` is a power of two.
+	  */
+	struct vm_memo {
+		size_t cap, len;
+		struct vm_memo_entry {
+			const struct vm_function *fn; // NULL for an empty slot
+			uint64_t hash;
+			size_t args; // index into `args` below
+			union vm_reg result;
+		} *items;
+		struct { size_t cap, len; union vm_reg *items; } args;
+		size_t hits, misses;
+	} memo;
+
+	// every instruction, and every node the analyzer evaluates, is a step.
+	// `execute()` fails with ERR_COMPTIME_STEPS once `steps` passes
+	// `step_limit` and with ERR_COMPTIME_TIME past `deadline_ns`
+	uint64_t steps;
+	uint64_t step_limit;  // UINT64_MAX for no limit
+	uint64_t deadline_ns; // see vm_now_ns(). 0 for no limit
+};
+
+enum vm_status : int8_t {
+	VM_OK,
+	VM_UNSUPPORTED, // can't be compiled. use the tree walker
+	VM_FAILED,      // evaluation failed. see `struct vm_error`
+};
+
+#define VM_MAX_CALL_DEPTH 4096
+#define VM_MAX_TRACE      8
+
+struct vm_error {
+	enum haste_value_error code;
+	enum token_kind op; // the operator that failed
+	struct location loc;
+	// for the budget errors: where the running calls were made, innermost
+	// first. a recursive call site is listed once, `trace_calls` counts it
+	uint32_t trace_len;
+	struct location trace[VM_MAX_TRACE];
+	uint32_t trace_calls[VM_MAX_TRACE];
+};
+
+/** @brief the wall clock in nanoseconds. what `deadline_ns` is measured in */
+uint64_t vm_now_ns(void);
+
+void vm_init(struct vm *vm, struct Allocator allocator, struct vm_resolver resolver);
+void vm_deinit(struct vm *vm);
+/**
+  * @brief compiles and runs `expr`. it only handles numeric expressions and
+  * @brief gives the same value and type `analyze_node()` would give.
+  */
+enum vm_status vm_eval(struct vm *vm, struct haste_ast_node *expr, struct haste_value *out, struct vm_error *err);
+/** @brief compiles an analyzed function once. NULL if it can't be compiled */
+struct vm_function *vm_compile_function(struct vm *vm, const struct haste_ast_func_decl *decl);
+/** @brief runs `fn`. `args` have to be `fn->param_count` values of the parameter types */
+enum vm_status vm_call(struct vm *vm, struct vm_function *fn, const struct haste_value *args, struct haste_value *out, struct vm_error *err);
 
 //
 // analysis.c
 //
 
+/**
+  * Per-declaration memo of analysis results. Every top-level declaration
+  * gets a fingerprint: the hash of its AST combined with the fingerprints
+  * of the declarations it resolved. A declaration whose AST hash and
+  * dependency fingerprints still match is reused instead of re-analyzed.
+  *
+  * Cached values, and the struct types created while analyzing with the
+  * cache, are allocated from `allocator`. The type pool keeps pointing at
+  * those types, so `allocator` has to outlive the type pool, while the
+  * analysis allocator of each run can be dropped after it.
+  */
+struct analysis_cache {
+	struct Allocator allocator;
+	size_t len;
+	struct analysis_cache_entry {
+		const char *key; // declaration name
+		uint64_t ast_hash;
+		uint64_t fingerprint;
+		struct analysis_cache_deps {
+			size_t cap, len;
+			struct analysis_cache_dep {
+				const char *name;
+				uint64_t fingerprint;
+			} *items;
+		} deps;
+		bool is_constant : 1;
+		bool is_explicitly_comptime : 1;
+		struct haste_type type;
+		struct haste_value value;
+	} *items;
+
+	// stats of the last `analyze_incremental()` run
+	size_t reused, recomputed;
+};
+
+void analysis_cache_free(struct analysis_cache *cache);
+
 Error analyze_one_node(
 	struct Allocator allocator,
 	struct Allocator arena_allocator,
@@ -901,13 +1328,55 @@ Error analyze_one_node(
 Error analyze(struct Allocator allocator,
               struct Allocator arena_allocator,
               const source_file_id src);
+/**
+  * @brief same as `analyze()` but reuses the declarations in `cache` that didn't
+  * @brief change since the last run, and records the rest into it.
+  * @param cache can be NULL. then its just `analyze()`
+  */
+Error analyze_incremental(struct Allocator allocator,
+                          struct Allocator arena_allocator,
+                          const source_file_id src,
+                          struct analysis_cache *cache);
+
+// told about each top-level declaration once it is analyzed without errors,
+// in the order they finish. a declaration's dependencies finish before it
+struct declaration_sink {
+	void *ctx;
+	void (*done)(void *ctx, struct haste_ast_node *decl);
+};
+
+/**
+  * @brief same as `analyze()`, handing every finished declaration to `sink`
+  * @brief while the rest of the file is still being analyzed.
+  */
+Error analyze_streaming(struct Allocator allocator,
+                        struct Allocator arena_allocator,
+                        const source_file_id src,
+                        struct declaration_sink sink);
 //
 // codegen.c
 //
 Error codegen(
 	struct Allocator allocator,
 	const source_file_id src,
+	enum emit_kind emit,
+	const char *output_path,
+	bool dump_to_stderr);
+// `--pipeline`: declarations are lowered on a codegen thread as analysis
+// finishes them. feed `codegen_stream_sink()` to `analyze_streaming()`
+struct codegen_stream;
+struct codegen_stream *codegen_stream_begin(struct Allocator allocator, const source_file_id src);
+struct declaration_sink codegen_stream_sink(struct codegen_stream *stream);
+// waits for the queued declarations, then writes the module like `codegen()`
+// does and frees the stream. EMIT_NONE writes nothing
+Error codegen_stream_finish(
+	struct codegen_stream *stream,
+	enum emit_kind emit,
 	const char *output_path,
 	bool dump_to_stderr);
+// false when `--target-cpu` names a processor LLVM doesn't know for this host
+bool codegen_knows_cpu(const char *cpu);
+// JITs the module and runs its `main`. the exit status is what it returned
+Error codegen_run(struct Allocator allocator, const source_file_id src, int *exit_status);
 
 #endif // !HASTE_H_
@@ -43,6 +43,18 @@ static void close_dump_stream(const struct options *opts, stream_t out)
 		sclose(out);
 }
 
+// where `--llvm`/`--emit` output goes. NULL with `--dump`, which writes to stderr
+static const char *emit_output_path(enum emit_kind emit, char *path_buf, size_t path_buf_size)
+{
+	static const char *const extensions[] = {
+		[EMIT_LL] = ".ll", [EMIT_BC] = ".bc", [EMIT_ASM] = ".s", [EMIT_OBJ] = ".o",
+	};
+	if (g_options.do_dump) return NULL;
+	if (g_options.output_path) return g_options.output_path;
+	cwk_path_change_extension(g_options.source_path, extensions[emit], path_buf, path_buf_size);
+	return path_buf;
+}
+
 static void print_errno(void)
 {
 	fprintf(stderr, " * [%d] %s\n", errno, strerror(errno));
@@ -95,6 +107,27 @@ static int custom_format_ast(stream_t stream, struct modifier_stream mod, va_lis
 	return print_haste_ast(stream, node);
 }
 
+// `--incremental`: the source and then each of its edits, analyzed in order
+// through one cache the way an editor re-checks a buffer. each revision
+// reports how many declarations it could reuse
+static Error analyze_edits(struct Allocator allocator, struct Allocator arena_allocator, struct Allocator cache_allocator, source_file_id src)
+{
+	struct analysis_cache cache = { .allocator = cache_allocator };
+	Error err = OK;
+	for (int i = 0; i <= g_options.edit_count; i += 1) {
+		if (i > 0) src = obtain_source_file_id(NULL, g_options.edit_paths[i - 1]);
+		err = parse(arena_allocator, src, false);
+		// nothing the cache keeps may point into a run's own allocations
+		struct Arena run_arena = Arena(allocator);
+		if (not err) err = analyze_incremental(arena_get_allocator(&run_arena), arena_allocator, src, &cache);
+		arena_free(&run_arena);
+		flush_diagnostics();
+		println("revision {d}: {z} reused, {z} recomputed", i, cache.reused, cache.recomputed);
+	}
+	analysis_cache_free(&cache);
+	return err;
+}
+
 int main(int argc, char *argv[argc])
 {
 	int exit_code = 0;
@@ -102,6 +135,8 @@ int main(int argc, char *argv[argc])
 
 	Error err = parse_arguments(argc, (const char **)argv);
 	if (err) return 1;
+	// the parser exits on the first error, the reports still have to come out
+	atexit(flush_diagnostics);
 
 	define_format_specifier("string", custom_format_string);
 	define_format_specifier("token", custom_format_token);
@@ -130,6 +165,8 @@ int main(int argc, char *argv[argc])
 	// Sub-arena for analysis allocations (struct types, objects, strings)
 	struct Arena analysis_arena = Arena(c_allocator);
 	struct Allocator analysis_alloc = arena_get_allocator(&analysis_arena);
+	// `--incremental` only. the struct types it creates stay in the type pool
+	struct Arena cache_arena = Arena(c_allocator);
 
 	struct timer_list timers = {
 		.allocator = get_default_allocator(),
@@ -137,6 +174,12 @@ int main(int argc, char *argv[argc])
 
 	const source_file_id src = obtain_source_file_id(NULL, g_options.source_path);
 
+	if (g_options.incremental) {
+		err = analyze_edits(c_allocator, arena_allocator, arena_get_allocator(&cache_arena), src);
+		exit_code = err then 1 otherwise 0;
+		goto cleanup;
+	}
+
 	if (g_options.dump_tokens) {
 		char path_buf[4096];
 		stream_t out = open_dump_stream(".tokens", path_buf, sizeof(path_buf));
@@ -148,8 +191,15 @@ int main(int argc, char *argv[argc])
 		goto cleanup;
 	}
 
+	const enum emit_kind emit = g_options.emit != EMIT_NONE then g_options.emit otherwise EMIT_LL;
+	const bool emits = g_options.dump_llvm or g_options.emit != EMIT_NONE;
+	const bool pipelined = g_options.pipeline and emits and not g_options.dump_ast and not g_options.dump_sema and not g_options.run;
+	char out_path_buf[4096];
+
 	timer_start(&timers, "parser");
-	err = parse(arena_allocator, src);
+	// pipelined, each constant is only checked here. its tree is parsed
+	// again when analysis gets to it, and freed as soon as it is lowered
+	err = parse(arena_allocator, src, pipelined);
 	timer_stop(&timers, allocated);
 
 	if (err) { exit_code = 1; goto cleanup; }
@@ -167,9 +217,23 @@ int main(int argc, char *argv[argc])
 		goto cleanup;
 	}
 
+	if (pipelined) {
+		const char *out_path = emit_output_path(emit, out_path_buf, sizeof(out_path_buf));
+		timer_start(&timers, "analysis + codegen");
+		struct codegen_stream *stream = codegen_stream_begin(c_allocator, src);
+		err = analyze_streaming(analysis_alloc, arena_allocator, src, codegen_stream_sink(stream));
+		flush_diagnostics();
+		// after an error the stream is only torn down
+		Error codegen_err = codegen_stream_finish(stream, err then EMIT_NONE otherwise emit, out_path, out_path == NULL);
+		timer_stop(&timers, allocated);
+		if (err or codegen_err) exit_code = 1;
+		goto cleanup;
+	}
+
 	timer_start(&timers, "analysis");
 	err = analyze(analysis_alloc, arena_allocator,  src);
 	timer_stop(&timers, allocated);
+	flush_diagnostics();
 	if (err) { exit_code = 1; goto cleanup; }
 
 	if (g_options.dump_sema) {
@@ -181,46 +245,52 @@ int main(int argc, char *argv[argc])
 		goto cleanup;
 	}
 
-	if (g_options.dump_llvm) {
-		const char *llvm_path = NULL;
-		bool llvm_to_stderr = false;
-		char llvm_path_buf[4096];
-		if (g_options.do_dump) {
-			llvm_to_stderr = true;
-		} else {
-			llvm_path = g_options.output_path;
-			if (!llvm_path) {
-				cwk_path_change_extension(g_options.source_path, ".ll", llvm_path_buf, sizeof(llvm_path_buf));
-				llvm_path = llvm_path_buf;
-			}
-		}
+	if (g_options.run) {
+		int status = 0;
+		timer_start(&timers, "codegen + run");
+		err = codegen_run(c_allocator, src, &status);
+		timer_stop(&timers, allocated);
+		exit_code = err then 1 otherwise status;
+		goto cleanup;
+	}
+
+	if (emits) {
+		const char *out_path = emit_output_path(emit, out_path_buf, sizeof(out_path_buf));
 		timer_start(&timers, "codegen");
-		err = codegen(c_allocator, src,  llvm_path, llvm_to_stderr);
+		err = codegen(c_allocator, src, emit, out_path, out_path == NULL);
 		timer_stop(&timers, allocated);
 		if (err) { exit_code = 1; goto cleanup; }
 		goto cleanup;
 	}
 
 	timer_start(&timers, "codegen");
-	err = codegen(c_allocator, src,  NULL, false);
+	err = codegen(c_allocator, src, EMIT_NONE, NULL, false);
 	timer_stop(&timers, allocated);
 	if (err) { exit_code = 1; goto cleanup; }
 
-	// Cleanup source files
+cleanup:
+	flush_diagnostics();
+	if (g_options.do_measure and exit_code == 0) {
+		print_timing_report(timers);
+	}
+	marrfree(timers);
+
+	// the trees of declarations that were never lowered
+	leach (struct haste_ast_node, node, get_source_file_ast(src)) {
+		free_declaration_tree(node);
+	}
+
+	// Cleanup source files, after the last flush since it renders from them
 	for (size_t i = 0; i < sources.len; i++) {
 		struct source_file item = sources.items[i];
 		xdestroy(sources.allocator, strlen(item.path), item.path);
 		xdestroy(sources.allocator, strlen(item.content), item.content);
+		arrfree(sources.allocator, item.line_starts);
 	}
 	marrfree(sources);
 
-cleanup:
-	if (g_options.do_measure and exit_code == 0) {
-		print_timing_report(timers);
-	}
-	marrfree(timers);
-
 	arena_free(&analysis_arena);
+	arena_free(&cache_arena);
 	deinit_intern_table();
 	arena_free(&arena);
 	return exit_code;
@@ -9,6 +9,8 @@ static int print_usage(stream_t f, const char *prog)
 {
 	int amount = 0;
 	amount += sprintln(f, "Usage: {s} [options] [file]", prog);
+	amount += sprintln(f, "       {s} run [options] file [args...]   JIT the program and run its main", prog);
+	amount += sprintln(f, "       {s} --incremental [options] file [edits...]   Analyze each edit of file, reusing what didn't change", prog);
 	amount += sprintln(f, "Options:");
 	amount += sprintln(f, "  --tokens      Dump token stream and exit");
 	amount += sprintln(f, "  --ast         Dump AST after parsing/hoisting and exit");
@@ -16,21 +18,108 @@ static int print_usage(stream_t f, const char *prog)
 	amount += sprintln(f, "  --llvm        Dump LLVM IR and exit");
 	amount += sprintln(f, "  --dump        Write dump output to stderr instead of a file");
 	amount += sprintln(f, "  -o <file>     Write dump output to <file>");
+	amount += sprintln(f, "  --emit=<kind> Write the module as ll, bc, asm or obj");
+	amount += sprintln(f, "  -O0, -O1, -O2, -O3, -Os  Optimization pipeline to run before writing (default -O0)");
+	amount += sprintln(f, "  --target-cpu=<cpu>  CPU to generate code for. 'native' is this machine's");
+	amount += sprintln(f, "  --jit-cache=<dir>   With 'run', keep compiled programs in <dir> and reuse them");
+	amount += sprintln(f, "  --jobs=<n>          Lower and optimize the module on <n> threads (default 1)");
+	amount += sprintln(f, "  --pipeline          Lower each declaration on another thread as soon as it is analyzed");
 	amount += sprintln(f, "  --measure     Show timing report for each compiler phase");
 	amount += sprintln(f, "  --no-fun      Enable it if you hate fun");
 	amount += sprintln(f, "  --only-parse  to only parse the file and do syntactic analysis");
+	amount += sprintln(f, "  --no-comptime-vm  Fold constants with the tree walker instead of the bytecode VM");
+	amount += sprintln(f, "  --check-all   Analyze every declaration, not only the ones `main` reaches");
+	amount += sprintln(f, "  --max-errors=<n>  Stop after <n> errors (0 means no limit)");
+	amount += sprintln(f, "  --comptime-steps=<n>  Evaluation steps one declaration may take (default {z})", (size_t)DEFAULT_COMPTIME_STEPS);
+	amount += sprintln(f, "  --comptime-bytes=<n>  Bytes one declaration may allocate while evaluating (default {z})", (size_t)DEFAULT_COMPTIME_BYTES);
+	amount += sprintln(f, "  --comptime-ms=<n>     Milliseconds one declaration may evaluate for (default no limit)");
+	amount += sprintln(f, "  --comptime-total-steps=<n>, --comptime-total-bytes=<n>, --comptime-total-ms=<n>");
+	amount += sprintln(f, "                The same limits for the whole analysis (default no limit)");
 	amount += sprintln(f, "  --help        Show this help message and exit");
 	return amount;
 }
 
+// the kinds `--emit=` takes
+static bool parse_emit_kind(const char *name, enum emit_kind *out)
+{
+	static const struct { const char *name; enum emit_kind kind; } kinds[] = {
+		{ "ll",  EMIT_LL  },
+		{ "bc",  EMIT_BC  },
+		{ "asm", EMIT_ASM },
+		{ "obj", EMIT_OBJ },
+	};
+	for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i += 1) {
+		if (strcmp(name, kinds[i].name) == 0) {
+			*out = kinds[i].kind;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool parse_opt_level(const char *arg, enum opt_level *out)
+{
+	static const char *levels[] = {
+		[OPT_O0] = "-O0",
+		[OPT_O1] = "-O1",
+		[OPT_O2] = "-O2",
+		[OPT_O3] = "-O3",
+		[OPT_OS] = "-Os",
+	};
+	for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i += 1) {
+		if (strcmp(arg, levels[i]) == 0) {
+			*out = (enum opt_level)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// `--name=<n>`. true when `arg` is that flag, even if the number is bad
+static bool parse_count_flag(const char *arg, const char *name, uint64_t *out, Error *err)
+{
+	const size_t len = strlen(name);
+	if (strncmp(arg, name, len) != 0 or arg[len] != '=') return false;
+
+	char *end = NULL;
+	const unsigned long long n = strtoull(arg + len + 1, &end, 10);
+	if (end == arg + len + 1 or *end != '\0') {
+		eprintln("error: '{s}' expects a number. got '{s}'.", name, arg + len + 1);
+		*err = ERROR;
+		return true;
+	}
+	*out = (uint64_t)n;
+	return true;
+}
+
 Error parse_arguments(const int argc, const char *argv[argc])
 {
 	g_options = (struct options){
 		.source_path = NULL,
 		.output_path = NULL,
+		.codegen_jobs = 1,
+		.decl_budget = {
+			.steps = DEFAULT_COMPTIME_STEPS,
+			.bytes = DEFAULT_COMPTIME_BYTES,
+		},
+	};
+
+	struct { const char *name; uint64_t *out; } count_flags[] = {
+		{ "--comptime-steps",       &g_options.decl_budget.steps  },
+		{ "--comptime-bytes",       &g_options.decl_budget.bytes  },
+		{ "--comptime-ms",          &g_options.decl_budget.ms     },
+		{ "--comptime-total-steps", &g_options.total_budget.steps },
+		{ "--comptime-total-bytes", &g_options.total_budget.bytes },
+		{ "--comptime-total-ms",    &g_options.total_budget.ms    },
 	};
 
-	for (int i = 1; i < argc; i++) {
+	int first = 1;
+	if (argc > 1 and strcmp(argv[1], "run") == 0) {
+		g_options.run = true;
+		first = 2;
+	}
+
+	for (int i = first; i < argc; i++) {
 		if (strcmp(argv[i], "--tokens") == 0) {
 			g_options.dump_tokens = true;
 		} else if (strcmp(argv[i], "--ast") == 0) {
@@ -50,10 +139,68 @@ Error parse_arguments(const int argc, const char *argv[argc])
 				return ERROR;
 			}
 			g_options.output_path = argv[i];
+		} else if (strncmp(argv[i], "--emit=", 7) == 0) {
+			if (not parse_emit_kind(argv[i] + 7, &g_options.emit)) {
+				eprintln("error: '--emit' expects ll, bc, asm or obj. got '{s}'.", argv[i] + 7);
+				return ERROR;
+			}
+		} else if (strncmp(argv[i], "-O", 2) == 0) {
+			if (not parse_opt_level(argv[i], &g_options.opt_level)) {
+				eprintln("error: unknown optimization level '{s}'. expected -O0, -O1, -O2, -O3 or -Os.", argv[i]);
+				return ERROR;
+			}
+		} else if (strncmp(argv[i], "--target-cpu=", 13) == 0) {
+			if (argv[i][13] == '\0') {
+				eprintln("error: '--target-cpu' expects a CPU name.");
+				return ERROR;
+			}
+			g_options.target_cpu = argv[i] + 13;
+		} else if (strncmp(argv[i], "--jit-cache=", 12) == 0) {
+			if (argv[i][12] == '\0') {
+				eprintln("error: '--jit-cache' expects a directory.");
+				return ERROR;
+			}
+			g_options.jit_cache = argv[i] + 12;
 		} else if (strcmp(argv[i], "--no-fun") == 0) {
 			g_options.disable_fun = true;
 		} else if (strcmp(argv[i], "--only-parse") == 0) {
 			g_options.only_parse = true;
+		} else if (strcmp(argv[i], "--no-comptime-vm") == 0) {
+			g_options.no_comptime_vm = true;
+		} else if (strcmp(argv[i], "--check-all") == 0) {
+			g_options.check_all = true;
+		} else if (strncmp(argv[i], "--max-errors=", 13) == 0) {
+			uint64_t n = 0;
+			Error err = OK;
+			discard parse_count_flag(argv[i], "--max-errors", &n, &err);
+			if (err) return ERROR;
+			g_options.max_errors = (size_t)n;
+		} else if (strcmp(argv[i], "--incremental") == 0) {
+			g_options.incremental = true;
+		} else if (strcmp(argv[i], "--pipeline") == 0) {
+			g_options.pipeline = true;
+		} else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+			uint64_t n = 0;
+			Error err = OK;
+			discard parse_count_flag(argv[i], "--jobs", &n, &err);
+			if (err) return ERROR;
+			if (n == 0 or n > CODEGEN_MAX_JOBS) {
+				eprintln("error: '--jobs' expects a number from 1 to {d}. got '{s}'.", CODEGEN_MAX_JOBS, argv[i] + 7);
+				return ERROR;
+			}
+			g_options.codegen_jobs = (size_t)n;
+		} else if (strncmp(argv[i], "--comptime-", 11) == 0) {
+			Error err = OK;
+			bool known = false;
+			for (size_t j = 0; j < sizeof(count_flags) / sizeof(count_flags[0]) and not known; j += 1) {
+				known = parse_count_flag(argv[i], count_flags[j].name, count_flags[j].out, &err);
+			}
+			if (err) return ERROR;
+			if (not known) {
+				eprintln("error: unknown option '{s}'\n", argv[i]);
+				print_usage(serr, argv[0]);
+				return ERROR;
+			}
 		} else if (strcmp(argv[i], "--help") == 0) {
 			print_usage(sout, argv[0]);
 			exit(0);
@@ -63,6 +210,17 @@ Error parse_arguments(const int argc, const char *argv[argc])
 			return ERROR;
 		} else {
 			g_options.source_path = argv[i];
+			if (g_options.run) {
+				// the rest belongs to the program
+				g_options.program_argc = argc - i;
+				g_options.program_argv = &argv[i];
+				break;
+			}
+			if (g_options.incremental) {
+				g_options.edit_count = argc - i - 1;
+				g_options.edit_paths = &argv[i + 1];
+				break;
+			}
 		}
 	}
 
@@ -71,6 +229,18 @@ Error parse_arguments(const int argc, const char *argv[argc])
 		eprintln("\nerror: expected a file. provided none.");
 		return ERROR;
 	}
+	if (g_options.pipeline and g_options.codegen_jobs > 1) {
+		eprintln("error: '--pipeline' lowers on one thread, it can't be combined with '--jobs'.");
+		return ERROR;
+	}
+	if (g_options.jit_cache != NULL and not g_options.run) {
+		eprintln("error: '--jit-cache' only works with 'run'.");
+		return ERROR;
+	}
+	if (g_options.target_cpu != NULL and not codegen_knows_cpu(g_options.target_cpu)) {
+		eprintln("error: '{s}' is not a CPU this target knows. try '--target-cpu=native'.", g_options.target_cpu);
+		return ERROR;
+	}
 
 	return OK;
 }
@@ -11,6 +11,8 @@ struct parser {
 	// source_file_id src;
 	struct token previous;
 	bool has_error;
+	bool arena_per_declaration;
+	struct Arena scratch; // see decl_checked()
 };
 
 enum precedence {
@@ -54,6 +56,7 @@ static struct haste_ast_node *parse_precedence(struct parser *self, enum precede
 static struct haste_ast_node *func_call_infix(struct parser *self, struct haste_ast_node *callee);
 static struct haste_ast_node *return_prefix(struct parser *self);
 static struct haste_ast_node *do_prefix(struct parser *self);
+static struct haste_ast_node *if_prefix(struct parser *self);
 
 static struct token peek(struct parser *self);
 
@@ -90,7 +93,7 @@ static struct token previous(const struct parser *self)
 static void report_error_at(struct parser *self, struct token token, const char *restrict fmt, ...)
 {
 	va_list args; va_start(args, fmt);
-	f_vreport_at_token("Error", token, fmt, args);
+	f_vreport_at_token(DIAG_ERROR, token, fmt, args);
 	va_end(args);
 	self->has_error = true;
 	exit(1);
@@ -100,7 +103,7 @@ static void report_error(struct parser *self, const char *restrict fmt, ...)
 {
 	struct token token = peek(self);
 	va_list args; va_start(args, fmt);
-	f_vreport_at_token("Error", token, fmt, args);
+	f_vreport_at_token(DIAG_ERROR, token, fmt, args);
 	va_end(args);
 	self->has_error = true;
 	exit(1);
@@ -109,7 +112,7 @@ static void report_error(struct parser *self, const char *restrict fmt, ...)
 static void vreport_error(struct parser *self, const char *restrict fmt, va_list args)
 {
 	struct token token = peek(self);
-	f_vreport_at_token("Error", token, fmt, args);
+	f_vreport_at_token(DIAG_ERROR, token, fmt, args);
 	self->has_error = true;
 	exit(1);
 }
@@ -500,6 +503,7 @@ struct parser_rule get_rule_from_kind(enum token_kind kind)
 	case TK_KW_CAST:      return (struct parser_rule){ cast,                NULL,                 PREC_UNARY,   false };
 	case TK_KW_RETURN:    return (struct parser_rule){ return_prefix,       NULL,                 PREC_NONE,    false };
 	case TK_KW_DO:        return (struct parser_rule){ do_prefix,           NULL,                 PREC_NONE,    false };
+	case TK_KW_IF:        return (struct parser_rule){ if_prefix,           NULL,                 PREC_NONE,    false };
 	case TK_OPEN_BRACE:   return (struct parser_rule){ NULL,                struct_literal_infix, PREC_PRIMARY, false };
 	case TK_DOT:          return (struct parser_rule){ auto_struct_prefix,  field_access,         PREC_PRIMARY, false };
 	default:              return (struct parser_rule){ NULL,                NULL,                 PREC_NONE,    false };
@@ -699,13 +703,13 @@ static struct haste_ast_node *func_call_infix(struct parser *self, struct haste_
 		.args = (void*)head.next);
 }
 
-static struct haste_ast_node *do_prefix(struct parser *self)
+// statements up to (not including) `end`, or `else` when `stop_at_else`
+static struct haste_ast_node *block_stmts(struct parser *self, bool stop_at_else)
 {
-	struct location start = as_location(previous(self));
 	struct haste_ast_node block_head_stmts = {0};
 	struct haste_ast_node *block_current = &block_head_stmts;
 
-	while (not check(self, TK_KW_END) and not ended(self)) {
+	while (not check(self, TK_KW_END) and not (stop_at_else and check(self, TK_KW_ELSE)) and not ended(self)) {
 		struct haste_ast_node *stamt = stmt(self);
 		block_current->next = stamt;
 		block_current = block_current->next;
@@ -718,14 +722,66 @@ static struct haste_ast_node *do_prefix(struct parser *self)
 		/* 	break; */
 		/* } */
 	}
+	return block_head_stmts.next;
+}
 
+static struct haste_ast_node *do_prefix(struct parser *self)
+{
+	struct location start = as_location(previous(self));
+	struct haste_ast_node *stmts = block_stmts(self, false);
 	struct location end = as_location(consume(self, TK_KW_END, "Expected 'end' after block."));
 	return create_node(
 		self,
 		struct haste_ast_block,
 		.base.kind = ND_BLOCK,
 		.base.location = location_conjoin(start, end),
-		.stmts = block_head_stmts.next);
+		.stmts = stmts);
+}
+
+static struct haste_ast_node *if_prefix(struct parser *self)
+{
+	struct location start = as_location(previous(self));
+	struct haste_ast_node *cond = expr(self);
+	struct location then_loc = as_location(consume(self, TK_KW_THEN, "Expected 'then' after the condition."));
+
+	struct haste_ast_node *then_stmts = block_stmts(self, true);
+	struct haste_ast_node *then_branch = create_node(
+		self,
+		struct haste_ast_block,
+		.base.kind = ND_BLOCK,
+		.base.location = location_conjoin(then_loc, as_location(peek(self))),
+		.stmts = then_stmts);
+
+	struct haste_ast_node *else_branch = NULL;
+	struct location end;
+	if (match(self, TK_KW_ELSE)) {
+		struct location else_loc = as_location(previous(self));
+		if (match(self, TK_KW_IF)) {
+			// `else if` shares the `end` of the `if` it continues
+			else_branch = if_prefix(self);
+			end = else_branch->location;
+		} else {
+			struct haste_ast_node *else_stmts = block_stmts(self, false);
+			end = as_location(consume(self, TK_KW_END, "Expected 'end' after 'else' branch."));
+			else_branch = create_node(
+				self,
+				struct haste_ast_block,
+				.base.kind = ND_BLOCK,
+				.base.location = location_conjoin(else_loc, end),
+				.stmts = else_stmts);
+		}
+	} else {
+		end = as_location(consume(self, TK_KW_END, "Expected 'else' or 'end' after 'then' branch."));
+	}
+
+	return create_node(
+		self,
+		struct haste_ast_if,
+		.base.kind = ND_IF,
+		.base.location = location_conjoin(start, end),
+		.cond = cond,
+		.then_branch = then_branch,
+		.else_branch = else_branch);
 }
 
 static struct haste_ast_node *return_prefix(struct parser *self)
@@ -789,11 +845,56 @@ static struct haste_ast_node *stmt(struct parser *self)
 	return expr(self);
 }
 
-Error parse(struct Allocator allocator, const source_file_id src)
+// Checks a top-level constant or variable without keeping its tree: it
+// is parsed into the scratch arena, which is reset right after. only the
+// node is kept in the file's allocator, since it is read until the end
+// (its slot, type and name). parse_declaration_tree() parses the tree
+// again when analysis gets to it, so the trees of a file are not all alive
+// at once. functions are kept whole, a later comptime call compiles their
+// body.
+static struct haste_ast_node *decl_checked(struct parser *self)
+{
+	const struct Allocator file_allocator = self->allocator;
+	self->allocator = arena_get_allocator(&self->scratch);
+	struct haste_ast_var_decl *parsed = (void*)decl(self, true);
+	self->allocator = file_allocator;
+	if (parsed == NULL) return NULL;
+
+	struct haste_ast_var_decl *node = (void*)_create_node(self, parsed, sizeof(*parsed));
+	node->type = NULL;
+	node->value = NULL;
+	node->tree_pending = true;
+	arena_reset(&self->scratch);
+	return &node->base;
+}
+
+void parse_declaration_tree(struct haste_ast_node *node)
+{
+	if (node->kind != ND_VAR_DECL) return;
+	struct haste_ast_var_decl *var = (void*)node;
+	if (not var->tree_pending) return;
+
+	struct Arena *arena = alloc(default_allocator, sizeof(struct Arena));
+	*arena = Arena(default_allocator);
+	struct parser parser = {
+		.allocator = arena_get_allocator(arena),
+		.stream = token_stream_at(node->location.src, node->location.start),
+	};
+	// it was checked by parse(), this cannot fail
+	const struct haste_ast_var_decl *parsed = (void*)decl(&parser, true);
+	var->type = parsed->type;
+	var->value = parsed->value;
+	var->tree_arena = arena;
+	var->tree_pending = false;
+}
+
+Error parse(struct Allocator allocator, const source_file_id src, bool arena_per_declaration)
 {
 	struct parser parser = {
 		.allocator = allocator,
 		.stream = token_stream(src),
+		.arena_per_declaration = arena_per_declaration,
+		.scratch = Arena(default_allocator),
 	};
 
 	struct haste_ast_node head = {0};
@@ -801,12 +902,18 @@ Error parse(struct Allocator allocator, const source_file_id src)
 	while (not ended(&parser)) {
 		while (match(&parser, TK_SEMI_COLON));
 
-		struct haste_ast_node *node = decl(&parser, true);
-		if (node == NULL) return ERROR;
+		const bool deferred = parser.arena_per_declaration
+			and (check(&parser, TK_KW_CONST) or check(&parser, TK_KW_VAR));
+		struct haste_ast_node *node = deferred then decl_checked(&parser) otherwise decl(&parser, true);
+		if (node == NULL) {
+			arena_free(&parser.scratch);
+			return ERROR;
+		}
 		current->next = node;
 		current = current->next;
 	}
 
+	arena_free(&parser.scratch);
 	sources.items[src].root = head.next;
 
 	return OK;
@@ -143,6 +143,43 @@ const char *get_source_file_end(const source_file_id id)
 	return get_source_file_content(id) + get_source_file_len(id);
 }
 
+static void index_line_starts(struct source_file *file)
+{
+	const char *content = file->content;
+	const char *end = content + file->len;
+
+	arrpush(sources.allocator, file->line_starts, 0);
+	// memchr is vectorized by libc, so this is a SIMD scan for newlines
+	for (const char *p = content; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; ) {
+		p += 1;
+		arrpush(sources.allocator, file->line_starts, (uint32_t)(p - content));
+	}
+}
+
+struct source_line get_source_line(const source_file_id id, uint32_t offset)
+{
+	assert(id < (int32_t)sources.len);
+	struct source_file *file = &sources.items[id];
+	if (file->line_starts.len == 0) {
+		index_line_starts(file);
+	}
+
+	// the last line that starts at or before `offset`
+	const uint32_t *starts = file->line_starts.items;
+	size_t lo = 0, hi = file->line_starts.len;
+	while (hi - lo > 1) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (starts[mid] <= offset) lo = mid;
+		else hi = mid;
+	}
+
+	return (struct source_line){
+		.number = (uint32_t)lo + 1,
+		.start = starts[lo],
+		.end = lo + 1 < file->line_starts.len then starts[lo + 1] - 1 otherwise (uint32_t)file->len,
+	};
+}
+
 SOURCE_GETTER(enum source_file_type, get_source_file_type, type)
 SOURCE_GETTER(struct haste_ast_node *, get_source_file_ast, root)
 /* SOURCE_GETTER(struct haste_declarations, get_source_file_declarations, declarations) */
@@ -1,11 +1,12 @@
 #include "haste.h"
 #include "my_stream.h"
 #include "my_temporary_allocator.h"
-#include "my_termcolor.h"
 #include <stdint.h>
 
 static bool is_digit(uint32_t c) { return c >= '0' and c <= '9'; }
 
+static void report_error(struct token_stream *self, const char *at, const char *restrict const fmt, ...);
+
 static const char *decode_string(const char *start, size_t len)
 {
 	char *chars = make(len + 1);
@@ -40,8 +41,18 @@ static void populate_token_value(struct token_stream *self, struct token *tok)
 
     switch (tok->kind) {
 	case TK_INT: {
-		char *buf = tsprint("{s:*}", self->content + tok->start, (int)tok->len);
-		tok->ival = strtoll(buf, NULL, 10);
+		haste_int value = 0;
+		for (uint32_t i = 0; i < tok->len; i += 1) {
+			const int digit = self->content[tok->start + i] - '0';
+			if (__builtin_mul_overflow(value, 10, &value)
+				or __builtin_add_overflow(value, digit, &value)) {
+				report_error(self, self->content + tok->start,
+					"integer literal is too big. the limit is {d} bits", STANDARD_BITWIDTH_LIMIT);
+				value = 0;
+				break;
+			}
+		}
+		tok->ival = value;
 	} break;
 	case TK_FLOAT: {
 		char *buf = tsprint("{s:*}", self->content + tok->start, (int)tok->len);
@@ -158,7 +169,7 @@ static struct token *add_token(struct token_stream *self, enum token_kind kind)
 static void report_error(struct token_stream *self, const char *at, const char *restrict const fmt, ...)
 {
 	va_list args; va_start(args, fmt);
-	if (self->src >= 0) f_vreport_at(self->src, ANSI_CODE_RED "Error", at, fmt, args);
+	if (self->src >= 0) f_vreport_at(self->src, DIAG_ERROR, at, fmt, args);
 	va_end(args);
 	self->has_error = true;
 }
@@ -166,7 +177,7 @@ static void report_error(struct token_stream *self, const char *at, const char *
 static void report_note(struct token_stream *self, const char *at, const char *restrict const fmt, ...)
 {
 	va_list args; va_start(args, fmt);
-	f_vreport_at(self->src, ANSI_CODE_GREEN "Note", at, fmt, args);
+	f_vreport_at(self->src, DIAG_NOTE, at, fmt, args);
 	va_end(args);
 }
 
@@ -360,6 +371,14 @@ struct token_stream token_stream(source_file_id src)
 	};
 }
 
+struct token_stream token_stream_at(source_file_id src, uint32_t offset)
+{
+	struct token_stream stream = token_stream(src);
+	stream.start = offset;
+	stream.current = offset;
+	return stream;
+}
+
 bool token_stream_ended(const struct token_stream *stream)
 {
 	return ended(stream) and is_empty(stream);
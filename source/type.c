@@ -1,5 +1,6 @@
 #include "haste.h"
 #include "my_common.h"
+#include <string.h>
 
 
 #define IS_UNKNOWN(type) \
@@ -27,52 +28,155 @@ struct haste_value into_value(struct haste_type type)
 	return type.value;
 }
 
-static struct haste_value make_struct_default(struct Allocator alloc, struct haste_type type, bool force_all)
+// Every default/zero value of a struct type is the same shared object,
+// struct_set_field and value_assign copy it before writing. it is built
+// with the type, see struct_type_build_shared().
+static struct haste_value make_struct_default(struct haste_type type, bool force_all)
 {
-	struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(type);
-	struct haste_struct_object *so = (void*)create_struct(alloc, st);
-	for (size_t i = 0; i < st->len; i += 1) {
-		if (force_all or IS_NONE(so->fields[i])) {
-			so->fields[i] = default_for_type(alloc, st->items[i].type);
-		}
-	}
-	return VAL_OBJ(AS_TYPEID(type), so);
+	const struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(type);
+	struct haste_struct_object *shared = force_all then st->shared_zero otherwise st->shared_default;
+	if (shared == NULL) unreachable(); // some field has no default value
+	return VAL_OBJ(AS_TYPEID(type), shared);
 }
 
-struct haste_value zero_for_type(struct Allocator alloc, struct haste_type to)
+struct haste_value zero_for_type(struct haste_type to)
 {
 	if (IS_STRUCT_TYPE(to))
-		return make_struct_default(alloc, to, true);
-	return default_for_type(alloc, to);
+		return make_struct_default(to, true);
+	return default_for_type(to);
 }
 
-struct haste_value default_for_type(struct Allocator alloc, struct haste_type type)
+struct haste_value default_for_type(struct haste_type type)
 {
 	if (type_is_integer(type)) return VAL_SCALAR(AS_TYPEID(type), .integer = 0);
 	if (type_is_float(type))   return VAL_SCALAR(AS_TYPEID(type), .floating = 0.0f);
 	if (type_equal(type, ty_cstr))
 		return VAL_OBJ(AS_TYPEID(type), &_default_empty_string);
 	if (IS_STRUCT_TYPE(type))
-		return make_struct_default(alloc, type, false);
+		return make_struct_default(type, false);
 	unreachable();
 }
 
-ssize_t find_named_field(const struct haste_type tp, const char *name)
+// structs up to this many fields are searched linearly
+#define FIELD_INDEX_MIN_FIELDS 8
+
+static size_t field_index_slot(const char *name, uint32_t cap)
 {
-	if (not IS_STRUCT_TYPE(tp) and not IS_AUTO_STRUCT_TYPE(tp)) {
-		return -1;
+	return (size_t)(((uintptr_t)name >> 3) * 0x9E3779B97F4A7C15ull) & (cap - 1);
+}
+
+// Interns every field name, so lookups compare pointers, and hashes them
+// into an open-addressed table when the struct is big enough for it. runs
+// when the type is created, before its id is handed out, so a lookup never
+// writes to the type.
+void struct_type_index_fields(struct Allocator alloc, struct haste_struct_type_info *st)
+{
+	iarreach (i, *st) {
+		st->items[i].name = intern_cstr(st->items[i].name);
+	}
+
+	if (st->len > FIELD_INDEX_MIN_FIELDS) {
+		uint32_t cap = 16;
+		while (cap < st->len * 2) cap *= 2;
+
+		st->index = alloc(alloc, sizeof(uint32_t) * cap);
+		memset(st->index, 0, sizeof(uint32_t) * cap);
+		st->index_cap = cap;
+
+		iarreach (i, *st) {
+			size_t slot = field_index_slot(st->items[i].name, cap);
+			while (st->index[slot] != 0) slot = (slot + 1) & (cap - 1);
+			st->index[slot] = (uint32_t)i + 1; // 0 is an empty slot
+		}
 	}
+}
 
-	struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(tp);
-	for (size_t i = 0; i < st->len; i += 1) {
-		if (strcmp(st->items[i].name, name) == 0) {
-			return i;
+static bool type_has_default(struct haste_type type)
+{
+	if (type_is_integer(type) or type_is_float(type) or type_equal(type, ty_cstr)) return true;
+	return IS_STRUCT_TYPE(type) and AS_STRUCT_TYPE_INFO(type)->shared_default != NULL;
+}
+
+static struct haste_struct_object *build_shared_default(struct Allocator alloc, struct haste_struct_type_info *st, bool force_all)
+{
+	struct haste_struct_object *so = (void*)create_struct(alloc, st);
+	iarreach (i, *st) {
+		if (force_all or IS_NONE(struct_object_get(so, st, i))) {
+			struct_object_put(so, st, i, default_for_type(st->items[i].type));
+		}
+	}
+	so->base.is_shared = true;
+	return so;
+}
+
+// Builds the shared instances create_struct and make_struct_default hand
+// out, from `alloc`, which must live as long as the type. like the field
+// index it runs before the id is handed out, so nothing writes to a
+// published type. when a field's type has no default value (a `type`, say)
+// the defaulted instances stay NULL, asking for them is a compiler bug.
+void struct_type_build_shared(struct Allocator alloc, struct haste_struct_type_info *st)
+{
+	struct haste_struct_object *initial = alloc_struct_object(alloc, st->len);
+	iarreach (i, *st) {
+		struct haste_struct_field field = st->items[i];
+		if (field.has_default) {
+			struct haste_value value = field.default_value;
+			if (not type_equal(typeof_value(field.default_value), field.type)) {
+				value = value_cast(alloc, field.type, field.default_value);
+			}
+			struct_object_put(initial, st, i, value);
+		}
+	}
+	initial->base.is_shared = true;
+	st->shared_initial = initial;
+
+	iarreach (i, *st) {
+		if (not type_has_default(st->items[i].type)) return;
+	}
+	st->shared_default = build_shared_default(alloc, st, false);
+	st->shared_zero = build_shared_default(alloc, st, true);
+}
+
+static ssize_t lookup_field(const struct haste_struct_type_info *st, const char *name)
+{
+	if (st->index == NULL) {
+		iarreach (i, *st) {
+			if (st->items[i].name == name) return i;
 		}
+		return -1;
 	}
 
+	for (size_t slot = field_index_slot(name, st->index_cap);
+		 st->index[slot] != 0;
+		 slot = (slot + 1) & (st->index_cap - 1)) {
+		const uint32_t idx = st->index[slot] - 1;
+		if (st->items[idx].name == name) return idx;
+	}
 	return -1;
 }
 
+ssize_t struct_field_index(const struct haste_struct_type_info *st, const char *name)
+{
+	ssize_t idx = lookup_field(st, name);
+	if (idx >= 0) return idx;
+
+	// identifiers from the source are already interned. anything else
+	// (builtin names like "ptr") is compared by content
+	iarreach (i, *st) {
+		if (strcmp(st->items[i].name, name) == 0) return i;
+	}
+	return -1;
+}
+
+ssize_t find_named_field(const struct haste_type tp, const char *name)
+{
+	if (not IS_STRUCT_TYPE(tp) and not IS_AUTO_STRUCT_TYPE(tp)) {
+		return -1;
+	}
+
+	return struct_field_index(AS_STRUCT_TYPE_INFO(tp), name);
+}
+
 struct haste_type typeof_value(const struct haste_value value)
 {
 	switch (value.kind) {
@@ -101,42 +205,73 @@ struct haste_value make_value(struct Allocator alloc, const struct haste_type ty
 		return VAL_OBJ(AS_TYPEID(type), so);
 	}
 
-	return default_for_type(alloc, type);
+	return default_for_type(type);
 }
 
 bool type_equal(const struct haste_type v1,
                 const struct haste_type v2)
 {
-	const struct haste_type_info *t1 = AS_TYPE_INFO(v1);
-	const struct haste_type_info *t2 = AS_TYPE_INFO(v2);
-
-	return t1->pool_id == t2->pool_id;
+	// every slot's pool_id is its own index
+	return AS_TYPEID(v1) == AS_TYPEID(v2);
 }
 
-uint64_t type_hash(const struct haste_type t)
+uint64_t type_info_hash(const struct haste_type_info *ot)
 {
-	const struct haste_type_info *ot = AS_TYPE_INFO(t);
 	uint64_t h = ot->kind;
 
 	if (ot->name != NULL)
 		for (const char *p = ot->name; *p; p += 1)
 			h = h * 31 + (unsigned char)*p;
 
-	if (ot->kind == HASTE_TY_STRUCT) {
-		const struct haste_struct_type_info *st = (const struct haste_struct_type_info *)ot;
+	if (ot->kind == HASTE_TY_STRUCT or ot->kind == HASTE_TY_AUTO_STRUCT) {
+		const struct haste_struct_type_info *st = &ot->structure;
 		for (size_t i = 0; i < st->len; i += 1) {
 			for (const char *p = st->items[i].name; *p; p += 1)
 				h = h * 31 + (unsigned char)*p;
-			h = h * 31 + (uint64_t)st->items[i].type.value.kind;
+			h = h * 31 + AS_TYPEID(st->items[i].type);
 		}
 	}
 
 	return h;
 }
 
+uint64_t type_hash(const struct haste_type t)
+{
+	return type_info_hash(AS_TYPE_INFO(t));
+}
+
+uint16_t int_type_bits(const struct haste_type_info *info)
+{
+	return info->bit_size then info->bit_size otherwise STANDARD_BITWIDTH_LIMIT;
+}
+
+bool int_fits(haste_int value, uint16_t bits, bool is_unsigned)
+{
+	if (is_unsigned) {
+		if (value < 0) return false;
+		return bits >= 127 or value < ((haste_int)1 << bits);
+	}
+	if (bits >= 128) return true;
+	const haste_int limit = (haste_int)1 << (bits - 1);
+	return value >= -limit and value < limit;
+}
+
+// the two's complement truncation a runtime cast does. uint128 keeps the
+// bit pattern, so its values above INT128_MAX are negative here
+haste_int int_wrap(haste_int value, uint16_t bits, bool is_unsigned)
+{
+	if (bits >= 128) return value;
+	const haste_uint mask = ((haste_uint)1 << bits) - 1;
+	const haste_uint low = (haste_uint)value & mask;
+	if (is_unsigned) return (haste_int)low;
+
+	const haste_uint sign = (haste_uint)1 << (bits - 1);
+	return (haste_int)((low ^ sign) - sign);
+}
+
 bool type_is_any_string(const struct haste_type t)
 {
-	return AS_TYPE_INFO(t)->is_string;
+	return TYPE_FLAGS(AS_TYPEID(t)) & TYPE_FLAG_STRING;
 }
 
 struct haste_type untyped_to_typed(struct haste_type type)
@@ -152,32 +287,34 @@ struct haste_type untyped_to_typed(struct haste_type type)
 
 bool type_is_integer(const struct haste_type t)
 {
-	return AS_TYPE_INFO(t)->is_integer;
+	return TYPE_FLAGS(AS_TYPEID(t)) & TYPE_FLAG_INTEGER;
 }
 
 bool type_is_float(const struct haste_type t)
 {
-	return AS_TYPE_INFO(t)->is_float;
+	return TYPE_FLAGS(AS_TYPEID(t)) & TYPE_FLAG_FLOAT;
 }
 
 bool type_is_untyped_float(const struct haste_type t)
 {
-	return AS_TYPE_INFO(t)->is_float and AS_TYPE_INFO(t)->is_untyped;
+	const uint8_t flags = TYPE_FLAGS(AS_TYPEID(t));
+	return (flags & TYPE_FLAG_FLOAT) and (flags & TYPE_FLAG_UNTYPED);
 }
 
 bool type_is_number(const struct haste_type t)
 {
-	return type_is_integer(t) or type_is_float(t);
+	return TYPE_FLAGS(AS_TYPEID(t)) & (TYPE_FLAG_INTEGER | TYPE_FLAG_FLOAT);
 }
 
 bool type_is_untyped(const struct haste_type t)
 {
-	return AS_TYPE_INFO(t)->is_untyped;
+	return TYPE_FLAGS(AS_TYPEID(t)) & TYPE_FLAG_UNTYPED;
 }
 
 bool type_is_untyped_integer(const struct haste_type t)
 {
-	return AS_TYPE_INFO(t)->is_untyped and AS_TYPE_INFO(t)->is_integer;
+	const uint8_t flags = TYPE_FLAGS(AS_TYPEID(t));
+	return (flags & TYPE_FLAG_UNTYPED) and (flags & TYPE_FLAG_INTEGER);
 }
 
 bool type_is_untyped_number(const struct haste_type t)
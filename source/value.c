@@ -9,8 +9,9 @@
 #include <string.h>
 
 
-#define TY_POOL_CHUNK 256
-#define ty_pool_get(pool, i) ((pool).chunks.items[(i) / TY_POOL_CHUNK][(i) % TY_POOL_CHUNK])
+#define ty_pool_get(i) (TYPE_POOL_CHUNK_OF(i)->infos[(i) % TY_POOL_CHUNK])
+
+static void type_pool_sync_hot(TypeID id);
 
 static struct haste_type_info *ensure_reserved_type(TypeID id)
 {
@@ -35,93 +36,211 @@ static struct haste_type_info *ensure_reserved_type(TypeID id)
 		.size = bytes,
 		.align = bytes < 8 ? bytes : 8,
 	);
+	type_pool_sync_hot(id);
 	return slot;
 }
 
 struct type_pool g_type_pool = {0};
 
-static void type_pool_grow(void)
+// the chunk `id` lands in. whoever gets there first allocates it, a thread
+// that loses the race frees its copy and takes the winner's
+static struct type_pool_chunk *type_pool_ensure_chunk(TypeID id)
+{
+	const size_t index = id / TY_POOL_CHUNK;
+	if (index >= TY_POOL_MAX_CHUNKS) {
+		eprintln("The type pool is full ({d} types).", TY_POOL_MAX_CHUNKS * TY_POOL_CHUNK);
+		Exit(1);
+	}
+
+	struct type_pool_chunk *chunk = atomic_load_explicit(&g_type_pool.chunks[index], memory_order_acquire);
+	if (chunk) return chunk;
+
+	struct type_pool_chunk *fresh = alloc(g_type_pool.allocator, sizeof(struct type_pool_chunk));
+	memset(fresh, 0, sizeof(struct type_pool_chunk));
+	fresh->infos = alloc(g_type_pool.allocator, sizeof(struct haste_type_info) * TY_POOL_CHUNK);
+	memset(fresh->infos, 0, sizeof(struct haste_type_info) * TY_POOL_CHUNK);
+
+	if (atomic_compare_exchange_strong_explicit(&g_type_pool.chunks[index], &chunk, fresh,
+	                                            memory_order_acq_rel, memory_order_acquire)) {
+		return fresh;
+	}
+	xdestroy(g_type_pool.allocator, sizeof(struct haste_type_info) * TY_POOL_CHUNK, fresh->infos);
+	xdestroy(g_type_pool.allocator, sizeof(struct type_pool_chunk), fresh);
+	return chunk;
+}
+
+// copies the fields of `id` that the type predicates read next to each
+// other. must run after every write to the slot that changes them
+static void type_pool_sync_hot(TypeID id)
 {
-	const size_t chunk_size = sizeof(struct haste_type_info) * TY_POOL_CHUNK;
-	void *chunk = alloc(g_type_pool.allocator, sizeof(struct haste_type_info) * TY_POOL_CHUNK);
-	memset(chunk, 0, chunk_size);
+	struct type_pool_chunk *chunk = TYPE_POOL_CHUNK_OF(id);
+	const struct haste_type_info *info = &chunk->infos[id % TY_POOL_CHUNK];
 
-	arrpush(g_type_pool.allocator, g_type_pool.chunks, chunk);
+	chunk->kinds[id % TY_POOL_CHUNK] = (uint8_t)info->kind;
+	chunk->flags[id % TY_POOL_CHUNK] = (uint8_t)(
+		(info->is_integer  then TYPE_FLAG_INTEGER  otherwise 0) |
+		(info->is_float    then TYPE_FLAG_FLOAT    otherwise 0) |
+		(info->is_unsigned then TYPE_FLAG_UNSIGNED otherwise 0) |
+		(info->is_string   then TYPE_FLAG_STRING   otherwise 0) |
+		(info->is_untyped  then TYPE_FLAG_UNTYPED  otherwise 0));
+	chunk->bits[id % TY_POOL_CHUNK] = (uint16_t)info->bit_size;
 }
 
 TypeID type_pool_add(struct haste_type_info type)
 {
-	if (g_type_pool.len >= g_type_pool.chunks.len * TY_POOL_CHUNK) {
-		type_pool_grow();
-	}
-	TypeID id = g_type_pool.len++;
-	struct haste_type_info *slot = &ty_pool_get(g_type_pool, id);
+	const TypeID id = atomic_fetch_add_explicit(&g_type_pool.len, 1, memory_order_acq_rel);
+	struct haste_type_info *slot = &type_pool_ensure_chunk(id)->infos[id % TY_POOL_CHUNK];
 
 	*slot = type;
 
 	slot->pool_id = id;
+	type_pool_sync_hot(id);
 	return id;
 }
 
-struct haste_type_info *type_pool_get(TypeID id)
+TypeID type_pool_len(void)
+{
+	return atomic_load_explicit(&g_type_pool.len, memory_order_acquire);
+}
+
+static bool type_same_shape(const struct haste_type_info *a, const struct haste_type_info *b)
+{
+	if (a->kind != b->kind) return false;
+	if (a->structure.len != b->structure.len) return false;
+
+	iarreach (i, a->structure) {
+		const struct haste_struct_field *fa = &a->structure.items[i];
+		const struct haste_struct_field *fb = &b->structure.items[i];
+		if (fa->name != fb->name and strcmp(fa->name, fb->name) != 0) return false;
+		if (AS_TYPEID(fa->type) != AS_TYPEID(fb->type)) return false;
+	}
+	return true;
+}
+
+static void type_intern_grow(void)
+{
+	const size_t old_cap = g_type_pool.interned.cap;
+	struct type_intern_slot *old_items = g_type_pool.interned.items;
+	const size_t cap = old_cap then old_cap * 2 otherwise 64;
+
+	g_type_pool.interned.items = alloc(g_type_pool.allocator, sizeof(struct type_intern_slot) * cap);
+	memset(g_type_pool.interned.items, 0, sizeof(struct type_intern_slot) * cap);
+	g_type_pool.interned.cap = cap;
+
+	for (size_t i = 0; i < old_cap; i += 1) {
+		if (old_items[i].id == 0) continue;
+		size_t j = old_items[i].hash & (cap - 1);
+		while (g_type_pool.interned.items[j].id != 0) j = (j + 1) & (cap - 1);
+		g_type_pool.interned.items[j] = old_items[i];
+	}
+	if (old_items) xdestroy(g_type_pool.allocator, sizeof(struct type_intern_slot) * old_cap, old_items);
+}
+
+static TypeID type_pool_intern_locked(struct haste_type_info type, bool *existed)
+{
+	if ((g_type_pool.interned.len + 1) * 4 > g_type_pool.interned.cap * 3) {
+		type_intern_grow();
+	}
+
+	const uint64_t hash = type_info_hash(&type);
+	const size_t mask = g_type_pool.interned.cap - 1;
+	size_t i = hash & mask;
+	for (; g_type_pool.interned.items[i].id != 0; i = (i + 1) & mask) {
+		struct type_intern_slot slot = g_type_pool.interned.items[i];
+		if (slot.hash == hash and type_same_shape(type_pool_get(slot.id), &type)) {
+			if (existed) *existed = true;
+			return slot.id;
+		}
+	}
+
+	TypeID id = type_pool_add(type);
+	g_type_pool.interned.items[i] = (struct type_intern_slot){ .hash = hash, .id = id };
+	g_type_pool.interned.len += 1;
+	if (existed) *existed = false;
+	return id;
+}
+
+// Structural types (automatic structs) are hash-consed: two identical shapes
+// share one TypeID. Nominal types must keep going through type_pool_add.
+// Reserved ids are never interned, so id 0 marks an empty slot.
+// The table is the one part of the pool behind a lock: a lookup and the
+// insert after it must not interleave with another thread's.
+TypeID type_pool_intern(struct haste_type_info type, bool *existed)
 {
-	assert(id < g_type_pool.len);
-	return &ty_pool_get(g_type_pool, id);
+	assert(type.kind == HASTE_TY_AUTO_STRUCT);
+
+	while (atomic_flag_test_and_set_explicit(&g_type_pool.interned_lock, memory_order_acquire)) {
+		// spin. the critical section is one probe sequence
+	}
+
+	const TypeID id = type_pool_intern_locked(type, existed);
+	atomic_flag_clear_explicit(&g_type_pool.interned_lock, memory_order_release);
+	return id;
 }
 
-void type_pool_set_name(TypeID id, const char *name)
+struct haste_type_info *type_pool_get(TypeID id)
 {
-	if (HASTE_TID_IS_RESERVED(id)) return;
-	assert(id < g_type_pool.len);
-	ty_pool_get(g_type_pool, id).name = name;
+	assert(id < type_pool_len());
+	return &ty_pool_get(id);
 }
 
-struct haste_type ty_int            = {0};
-struct haste_type ty_uint           = {0};
-struct haste_type ty_zero           = {0};
-struct haste_type ty_unknown        = {0};
-struct haste_type ty_type           = {0};
-struct haste_type ty_untyped_int    = {0};
-struct haste_type ty_float          = {0};
-struct haste_type ty_untyped_float  = {0};
-struct haste_type ty_auto           = {0};
-struct haste_type ty_void           = {0};
-struct haste_type ty_untyped_string = {0};
-struct haste_type ty_string         = {0};
-struct haste_type ty_cstr           = {0};
-struct haste_type ty_usize          = {0};
+#define BUILTIN_TYPE(id_) \
+	{ { .kind = HASTE_VL_TYPE, .type_id = HASTE_TID_TYPE, .type = (id_) } }
+
+const struct haste_type ty_int            = BUILTIN_TYPE(HASTE_TID_RESERVED_INT_BASE + 32);
+const struct haste_type ty_uint           = BUILTIN_TYPE(HASTE_TID_RESERVED_UINT_BASE + 32);
+const struct haste_type ty_zero           = BUILTIN_TYPE(HASTE_TID_ZERO);
+const struct haste_type ty_unknown        = BUILTIN_TYPE(HASTE_TID_UNKNOWN);
+const struct haste_type ty_type           = BUILTIN_TYPE(HASTE_TID_TYPE);
+const struct haste_type ty_untyped_int    = BUILTIN_TYPE(HASTE_TID_UNTYPED_INT);
+const struct haste_type ty_float          = BUILTIN_TYPE(HASTE_TID_FLOAT);
+const struct haste_type ty_untyped_float  = BUILTIN_TYPE(HASTE_TID_UNTYPED_FLOAT);
+const struct haste_type ty_auto           = BUILTIN_TYPE(HASTE_TID_AUTO);
+const struct haste_type ty_void           = BUILTIN_TYPE(HASTE_TID_VOID);
+const struct haste_type ty_untyped_string = BUILTIN_TYPE(HASTE_TID_UNTYPED_STRING);
+const struct haste_type ty_string         = BUILTIN_TYPE(HASTE_TID_STRING);
+const struct haste_type ty_cstr           = BUILTIN_TYPE(HASTE_TID_CSTR);
+const struct haste_type ty_usize          = BUILTIN_TYPE(HASTE_TID_USIZE);
 
 struct haste_value type_get_int(uint16_t bits, bool is_signed)
 {
+	// the reserved types are all filled in by setup_builtins
 	TypeID base = is_signed ? HASTE_TID_RESERVED_INT_BASE : HASTE_TID_RESERVED_UINT_BASE;
-	ensure_reserved_type(base + bits);
 	return VAL_TYPE(base + bits);
 }
 
 static uint32_t _builtin_end = 0;
-static uint32_t _new_type_therhold = 0;
 
+// runs before any other thread touches the pool
 void setup_builtins(struct Allocator allocator)
 {
 	g_type_pool.allocator = allocator;
-	while (g_type_pool.chunks.len * TY_POOL_CHUNK <= HASTE_TID_TOTAL_RESERVED) {
-		type_pool_grow();
+	atomic_flag_clear(&g_type_pool.interned_lock);
+	for (TypeID id = 0; id <= HASTE_TID_TOTAL_RESERVED; id += TY_POOL_CHUNK) {
+		type_pool_ensure_chunk(id);
 	}
+	type_pool_ensure_chunk(HASTE_TID_TOTAL_RESERVED);
+	atomic_store_explicit(&g_type_pool.len, (uint32_t)HASTE_TID_TOTAL_RESERVED + 1, memory_order_release);
 
-	g_type_pool.len = (uint32_t)HASTE_TID_TOTAL_RESERVED + 1;
-
-	TypeID tid_type = type_pool_add(TYPE_INFO(.kind = HASTE_TY_TYPE, .size = 8, .align = 8, .name = "type"));
-	ty_type = into_type((struct haste_value) {
-		.kind = HASTE_VL_TYPE,
-		.type_id = tid_type,
-		.type = tid_type});
+	// filled in up front, so asking for an intN never writes to the pool
+	for (TypeID id = 0; id <= HASTE_TID_TOTAL_RESERVED; id += 1) {
+		ensure_reserved_type(id);
+	}
 
+	// the ty_* handles are constants, each add has to land on its id
 #define REGISTER_BUILTIN(val_, ...) \
 	do { \
-		TypeID tid = type_pool_add((struct haste_type_info) { __VA_ARGS__ });	\
-		(val_) = into_type(VAL_TYPE(tid)); \
+		const TypeID tid = type_pool_add((struct haste_type_info) { __VA_ARGS__ });	\
+		assert(tid == AS_TYPEID(val_)); \
+		discard tid; \
 	} while (0)
 
+	REGISTER_BUILTIN(ty_type,
+					 .kind = HASTE_TY_TYPE,
+					 .size = 8,
+					 .align = 8,
+					 .name = "type");
+
 	REGISTER_BUILTIN(ty_zero,           
 					 .kind = HASTE_TY_ZERO,                                  
 					 .name = "zero");
@@ -171,6 +290,7 @@ void setup_builtins(struct Allocator allocator)
 					 .kind = HASTE_TY_USIZE, 
 					 .size = 8, 
 					 .align = 8,          
+					 .bit_size = 64,
 					 .name = "usize",
 					 .is_integer = true, .is_unsigned = true);
 
@@ -186,30 +306,25 @@ void setup_builtins(struct Allocator allocator)
 			.name = "len",
 			.type = ty_usize,
 		};
-		const struct haste_type_info string_type_info = TYPE_INFO(
+		struct haste_type_info string_type_info = TYPE_INFO(
 			.kind = HASTE_TY_STRUCT,
+			.name = "string",
+			.is_string = true,
 			.structure = {
 				.len = 2,
 				.items = string_fields,
 			});
+		struct_type_index_fields(g_type_pool.allocator, &string_type_info.structure);
+		struct_type_build_shared(g_type_pool.allocator, &string_type_info.structure);
 		const TypeID string_id = type_pool_add(string_type_info);
-		ty_string = into_type(VAL_TYPE(string_id));
-		AS_TYPE_INFO(ty_string)->name = "string";
-		AS_TYPE_INFO(ty_string)->is_string = true;
+		assert(string_id == AS_TYPEID(ty_string));
+		discard string_id;
 	}
 
-	{
-		ty_int = into_type(VAL_TYPE(ensure_reserved_type(32)->pool_id));
-		AS_TYPE_INFO(ty_int)->name = "int";
-	}
-
-	{
-		ty_uint = into_type(VAL_TYPE(ensure_reserved_type(HASTE_TID_RESERVED_UINT_BASE + 32)->pool_id));
-		AS_TYPE_INFO(ty_uint)->name = "uint";
-	}
+	AS_TYPE_INFO(ty_int)->name = "int";
+	AS_TYPE_INFO(ty_uint)->name = "uint";
 
-	_builtin_end = g_type_pool.len - 1;
-	_new_type_therhold = _builtin_end;
+	_builtin_end = type_pool_len() - 1;
 }
 
 bool type_is_builtin(struct haste_type ty)
@@ -217,16 +332,6 @@ bool type_is_builtin(struct haste_type ty)
 	return AS_TYPEID(ty) <= _builtin_end;
 }
 
-bool is_newly_created_type(struct haste_type ty)
-{
-	return AS_TYPEID(ty) >= _new_type_therhold;
-}
-
-void reset_new_type_counter(void)
-{
-	_new_type_therhold = g_type_pool.len - 1;
-}
-
 enum arith_op {
 	ARITH_ADD,
 	ARITH_SUB,
@@ -262,52 +367,65 @@ static struct haste_value arith_float(enum arith_op op, struct haste_value lhs,
 	return VAL_SCALAR(AS_TYPEID(ty_untyped_float), .floating = res);
 }
 
-static struct haste_value arith_int(enum arith_op op, struct haste_value lhs, struct haste_value rhs)
+// uint128 is the only type whose values don't fit in a haste_int, so it
+// gets its own unsigned path
+static struct haste_value arith_uint128(enum arith_op op, TypeID type, haste_uint a, haste_uint b)
 {
-	int64_t a = lhs.integer;
-	int64_t b = rhs.integer;
-	int64_t res = 0;
+	haste_uint res = 0;
+	bool overflow = false;
 
 	switch (op) {
-	case ARITH_ADD:
-		if ((b > 0 && a > INT64_MAX - b) or (b < 0 && a < INT64_MIN - b)) {
-			return VAL_BAD_ERROR(ERR_ARITH_OVERFLOW);
-		}
-		res = a + b;
-		break;
-	case ARITH_SUB:
-		if ((b > 0 && a < INT64_MIN + b) or (b < 0 && a > INT64_MAX + b)) {
-			return VAL_BAD_ERROR(ERR_ARITH_OVERFLOW);
-		}
-		res = a - b;
-		break;
-	case ARITH_MUL:
-		if (a != 0 and b != 0) {
-			if ((a > 0 and b > 0 and a > INT64_MAX / b)
-			    or (a > 0 and b < 0 and b < INT64_MIN / a)
-			    or (a < 0 and b > 0 and a < INT64_MIN / b)
-			    or (a < 0 and b < 0 and a < INT64_MAX / b)) {
-				return VAL_BAD_ERROR(ERR_ARITH_OVERFLOW);
-			}
+	case ARITH_ADD: overflow = __builtin_add_overflow(a, b, &res); break;
+	case ARITH_SUB: overflow = __builtin_sub_overflow(a, b, &res); break;
+	case ARITH_MUL: overflow = __builtin_mul_overflow(a, b, &res); break;
+	case ARITH_DIV:
+		if (b == 0) {
+			return VAL_BAD_ERROR(ERR_DIVISION_BY_ZERO);
 		}
-		res = a * b;
+		res = a / b;
 		break;
+	}
+
+	if (overflow) return VAL_BAD_ERROR(ERR_ARITH_OVERFLOW);
+	return VAL_SCALAR(type, .integer = (haste_int)res);
+}
+
+static struct haste_value arith_int(enum arith_op op, struct haste_value lhs, struct haste_value rhs)
+{
+	const TypeID type = type_equal(typeof_value(lhs), typeof_value(rhs))
+		then lhs.type_id
+		otherwise AS_TYPEID(ty_untyped_int);
+	const bool is_unsigned = TYPE_FLAGS(type) & TYPE_FLAG_UNSIGNED;
+	const uint16_t bits = TYPE_INT_BITS(type);
+
+	if (is_unsigned and bits == 128) {
+		return arith_uint128(op, type, (haste_uint)lhs.integer, (haste_uint)rhs.integer);
+	}
+
+	haste_int a = lhs.integer;
+	haste_int b = rhs.integer;
+	haste_int res = 0;
+	bool overflow = false;
+
+	switch (op) {
+	case ARITH_ADD: overflow = __builtin_add_overflow(a, b, &res); break;
+	case ARITH_SUB: overflow = __builtin_sub_overflow(a, b, &res); break;
+	case ARITH_MUL: overflow = __builtin_mul_overflow(a, b, &res); break;
 	case ARITH_DIV:
 		if (b == 0) {
 			return VAL_BAD_ERROR(ERR_DIVISION_BY_ZERO);
 		}
-		if (a == INT64_MIN and b == -1) {
+		if (a == HASTE_INT_MIN and b == -1) {
 			return VAL_BAD_ERROR(ERR_ARITH_OVERFLOW);
 		}
 		res = a / b;
 		break;
 	}
 
-	if (type_equal(typeof_value(lhs), typeof_value(rhs))) {
-		return VAL_SCALAR(lhs.type_id, .integer = res);
+	if (overflow or not int_fits(res, bits, is_unsigned)) {
+		return VAL_BAD_ERROR(ERR_ARITH_OVERFLOW);
 	}
-
-	return VAL_SCALAR(AS_TYPEID(ty_untyped_int), .integer = res);
+	return VAL_SCALAR(type, .integer = res);
 }
 
 static struct haste_value value_do_arith(
@@ -354,6 +472,10 @@ struct haste_value value_implicit_cast(struct Allocator alloc, const struct hast
 		if (type_is_float(to)) {
 			return VAL_SCALAR(AS_TYPEID(to), .floating = (double)value.integer);
 		}
+		const TypeID id = AS_TYPEID(to);
+		if (not int_fits(value.integer, TYPE_INT_BITS(id), TYPE_FLAGS(id) & TYPE_FLAG_UNSIGNED)) {
+			return VAL_BAD_ERROR(ERR_INT_OUT_OF_RANGE);
+		}
 		return VAL_SCALAR(AS_TYPEID(to), .integer = value.integer);
 	}
 
@@ -380,22 +502,26 @@ struct haste_value value_implicit_cast(struct Allocator alloc, const struct hast
 }
 
 typedef struct {
-	int64_t as_int;
+	haste_int as_int;
 	double as_float;
 	bool is_float;
 } RawNumber;
 
 static RawNumber extract_raw(struct haste_value value)
 {
-	if (type_is_integer(typeof_value(value)))   return (RawNumber){ .as_int = value.integer,           .as_float = (double)value.integer, };
-	if (type_is_float(typeof_value(value))) return (RawNumber){ .as_int = (int64_t)value.floating, .as_float = value.floating, };
+	const uint8_t flags = TYPE_FLAGS(value.type_id);
+	if ((flags & TYPE_FLAG_INTEGER) and (flags & TYPE_FLAG_UNSIGNED)) return (RawNumber){ .as_int = value.integer,             .as_float = (double)(haste_uint)value.integer, };
+	if (flags & TYPE_FLAG_INTEGER)                                    return (RawNumber){ .as_int = value.integer,             .as_float = (double)value.integer, };
+	if (flags & TYPE_FLAG_FLOAT)                                      return (RawNumber){ .as_int = (haste_int)value.floating, .as_float = value.floating, };
 	unreachable();
 }
 
 static struct haste_value construct_from_raw(struct haste_type to, RawNumber raw)
 {
-	if (type_is_integer(to))
-		return VAL_SCALAR(AS_TYPEID(to), .integer = raw.as_int);
+	if (type_is_integer(to)) {
+		const TypeID id = AS_TYPEID(to);
+		return VAL_SCALAR(id, .integer = int_wrap(raw.as_int, TYPE_INT_BITS(id), TYPE_FLAGS(id) & TYPE_FLAG_UNSIGNED));
+	}
 
 	if (type_is_float(to))
 		return VAL_SCALAR(AS_TYPEID(to), .floating = raw.as_float);
@@ -413,6 +539,25 @@ static struct haste_value value_cast_string_to_struct(struct Allocator alloc, co
 	return so;
 }
 
+static struct haste_struct_object *clone_struct_object(struct Allocator alloc, const struct haste_struct_object *so)
+{
+	struct haste_struct_object *copy = alloc(alloc, STRUCT_OBJECT_SIZE(so->len));
+	memcpy(copy, so, STRUCT_OBJECT_SIZE(so->len));
+	copy->base.is_shared = false;
+	return copy;
+}
+
+// copy-on-write: gives `value` its own object before it gets modified
+static struct haste_struct_object *unshare_struct(struct Allocator alloc, struct haste_value *value)
+{
+	struct haste_struct_object *so = AS_STRUCT(*value);
+	if (so->base.is_shared) {
+		so = clone_struct_object(alloc, so);
+		value->obj = &so->base;
+	}
+	return so;
+}
+
 static struct haste_value value_cast_auto_struct(
 	struct Allocator alloc,
 	const struct haste_type to,
@@ -423,13 +568,14 @@ static struct haste_value value_cast_auto_struct(
 	const struct haste_struct_type_info *val_st = AS_STRUCT_TYPE_INFO(value_type);
 	const struct haste_struct_object *val_so = AS_STRUCT(value);
 
-	struct haste_value result = default_for_type(alloc, to);
-	struct haste_struct_object *so = AS_STRUCT(result);
+	struct haste_value result = default_for_type(to);
+	struct haste_struct_object *so = unshare_struct(alloc, &result);
 
 	for (size_t i = 0; i < to_st->len; i += 1) {
 		for (size_t j = 0; j < val_st->len; j += 1) {
 			if (strcmp(to_st->items[i].name, val_st->items[j].name) == 0) {
-				so->fields[i] = value_cast(alloc, to_st->items[i].type, val_so->fields[j]);
+				struct haste_value field = struct_object_get(val_so, val_st, j);
+				struct_object_put(so, to_st, i, value_cast(alloc, to_st->items[i].type, field));
 				break;
 			}
 		}
@@ -473,8 +619,8 @@ struct haste_value value_cast(
 		if (not IS_BAD(implicit)) return implicit;
 	}
 
-	if (value_equal(value, VAL_UNINIT))    return default_for_type(alloc, to);
-	if (IS_ZERO(value))                    return zero_for_type(alloc, to);
+	if (value_equal(value, VAL_UNINIT))    return default_for_type(to);
+	if (IS_ZERO(value))                    return zero_for_type(to);
 
 	if (type_equal(to, ty_string) and IS_OBJ(value) and value.obj->kind == HASTE_OBJ_STRING)
 		return value_cast_string_to_struct(alloc, to, value);
@@ -482,7 +628,7 @@ struct haste_value value_cast(
 	if (type_equal(to, ty_cstr) and IS_STRUCT(value)) {
 		ssize_t idx = find_named_field(typeof_value(value), "ptr");
 		assert(idx >= 0);
-		return AS_STRUCT(value)->fields[(size_t)idx];
+		return struct_object_get(AS_STRUCT(value), AS_STRUCT_TYPE_INFO(typeof_value(value)), (size_t)idx);
 	}
 
 	if (type_is_any_string(to) and IS_OBJ(value) and value.obj->kind == HASTE_OBJ_STRING)
@@ -507,9 +653,9 @@ struct haste_value value_assign(struct Allocator alloc, struct haste_value *lval
 	struct haste_value result = value_implicit_cast(alloc, lhs_type, rvalue);
 	if (IS_BAD(result)) {
 		if (IS_ZERO(rvalue)) {
-			result = zero_for_type(alloc, lhs_type);
+			result = zero_for_type(lhs_type);
 		} else if (IS_UNINIT(rvalue)) {
-			result = default_for_type(alloc, lhs_type);
+			result = default_for_type(lhs_type);
 		} else if (IS_STRUCT_TYPE(lhs_type) and IS_AUTO_STRUCT_TYPE(typeof_value(rvalue))) {
 			result = value_cast(alloc, lhs_type, rvalue);
 		}
@@ -517,12 +663,10 @@ struct haste_value value_assign(struct Allocator alloc, struct haste_value *lval
 	if (IS_BAD(result)) return result;
 
 	if (IS_STRUCT(*lvalue) and IS_STRUCT(result)) {
-		struct haste_struct_object *lso = AS_STRUCT(*lvalue);
+		struct haste_struct_object *lso = unshare_struct(alloc, lvalue);
 		struct haste_struct_object *rso = AS_STRUCT(result);
 		struct haste_struct_type_info *st = AS_STRUCT_TYPE_INFO(lhs_type);
-		iarreach (i, *st) {
-			lso->fields[i] = rso->fields[i];
-		}
+		memcpy(lso->data, rso->data, STRUCT_OBJECT_SIZE(st->len) - sizeof(struct haste_struct_object));
 	} else {
 		*lvalue = result;
 	}
@@ -538,31 +682,69 @@ struct haste_value value_coerce(struct Allocator alloc, const struct haste_type
 	return value_assign(alloc, &slot, value);
 }
 
-struct haste_object *create_struct(struct Allocator alloc, struct haste_struct_type_info *st)
+struct haste_struct_object *alloc_struct_object(struct Allocator alloc, size_t field_count)
 {
-	assert(st != NULL);
-
-	struct haste_struct_object *so = alloc(
-		alloc,
-		sizeof(struct haste_struct_object) +
-		sizeof(struct haste_value) *
-		SAFE_COUNT(st->len));
+	struct haste_struct_object *so = alloc(alloc, STRUCT_OBJECT_SIZE(field_count));
 	so->base.kind = HASTE_OBJ_STRUCT;
-	memset(so->fields, 0, sizeof(struct haste_value) * st->len);
-
-	iarreach (i, *st) {
-		struct haste_struct_field field = st->items[i];
-		if (field.has_default) {
-			so->fields[i] = field.default_value;
-			if (not type_equal(typeof_value(field.default_value), field.type)) {
-				so->fields[i] = value_cast(alloc, field.type, field.default_value);
-			}
-		} else {
-			so->fields[i] = VAL_NONE;
-		}
+	so->len = (uint32_t)field_count;
+	memset(STRUCT_OBJECT_TAGS(so), HASTE_VL_NONE, field_count);
+	return so;
+}
+
+#define TAG_KIND_MASK    0x3f
+#define TAG_COMPTIME_BIT 0x40
+#define TAG_LVALUE_BIT   0x80
+
+struct haste_value struct_object_get(const struct haste_struct_object *so, const struct haste_struct_type_info *st, size_t idx)
+{
+	assert(idx < so->len);
+	const uint8_t tag = STRUCT_OBJECT_TAGS(so)[idx];
+
+	struct haste_value value = {
+		.kind = tag & TAG_KIND_MASK,
+		.is_explicitly_comptime = (tag & TAG_COMPTIME_BIT) != 0,
+		.is_lvalue = (tag & TAG_LVALUE_BIT) != 0,
+	};
+	switch (value.kind) {
+	case HASTE_VL_NONE:
+	case HASTE_VL_ZERO:
+	case HASTE_VL_UNINIT:
+		break;
+	case HASTE_VL_BAD:
+		value.error_code = so->data[idx].error_code;
+		break;
+	case HASTE_VL_SCALAR:
+	case HASTE_VL_RUNTIME:
+	case HASTE_VL_TYPE:
+	case HASTE_VL_OBJ:
+		value.type_id = AS_TYPEID(st->items[idx].type);
+		memcpy(&value.integer, &so->data[idx], sizeof(union haste_payload));
+		break;
 	}
+	return value;
+}
 
-	return (void*)so;
+void struct_object_put(struct haste_struct_object *so, const struct haste_struct_type_info *st, size_t idx, struct haste_value value)
+{
+	assert(idx < so->len);
+	// only the payload is kept, the type is the field's
+	assert(not (IS_SCALAR(value) or IS_OBJ(value))
+		   or value.type_id == AS_TYPEID(st->items[idx].type));
+	discard st;
+
+	STRUCT_OBJECT_TAGS(so)[idx] = (uint8_t)(value.kind
+		| (value.is_explicitly_comptime then TAG_COMPTIME_BIT otherwise 0)
+		| (value.is_lvalue then TAG_LVALUE_BIT otherwise 0));
+	memcpy(&so->data[idx], &value.integer, sizeof(union haste_payload));
+}
+
+// Returns a new object with the fields a struct literal starts from (the
+// declared defaults, everything else unset), copied from the instance
+// struct_type_build_shared() made when the type was created.
+struct haste_object *create_struct(struct Allocator alloc, struct haste_struct_type_info *st)
+{
+	assert(st != NULL and st->shared_initial != NULL);
+	return &clone_struct_object(alloc, st->shared_initial)->base;
 }
 
 struct haste_object *create_string(struct Allocator alloc, const char *str, size_t len)
@@ -679,7 +861,7 @@ struct haste_value struct_get_field_by_index(const struct haste_value value,
 	if (idx >= st->len)
 		return VAL_BAD_ERROR(ERR_FIELD_DOESNT_EXIST);
 
-	return so->fields[idx];
+	return struct_object_get(so, st, idx);
 }
 
 // TODO: Should I do type checking here?
@@ -712,10 +894,29 @@ struct haste_value struct_set_field_by_index(struct Allocator allocator,
 	if (IS_BAD(casted))
 		return VAL_BAD_ERROR(ERR_INVALID_ASSIGNMET);
 
-	so->fields[idx] = casted;
+	so = unshare_struct(allocator, value);
+	struct_object_put(so, st, idx, casted);
 	return *value;
 }
 
+int print_haste_int(stream_t stream, haste_int value, bool is_unsigned)
+{
+	if ((not is_unsigned or value >= 0) and value >= INT64_MIN and value <= INT64_MAX)
+		return sprint(stream, "{i64}", (int64_t)value);
+
+	const bool negative = not is_unsigned and value < 0;
+	haste_uint magnitude = negative then -(haste_uint)value otherwise (haste_uint)value;
+	char buf[41];
+	size_t at = sizeof(buf);
+	buf[--at] = '\0';
+	do {
+		buf[--at] = (char)('0' + (int)(magnitude % 10));
+		magnitude /= 10;
+	} while (magnitude != 0);
+	if (negative) buf[--at] = '-';
+	return sprint(stream, "{s}", buf + at);
+}
+
 int print_object(stream_t stream, const struct haste_object *obj, struct haste_type type)
 {
 	int printed_amount = 0;
@@ -731,7 +932,7 @@ int print_object(stream_t stream, const struct haste_object *obj, struct haste_t
 		printed_amount += sprint(stream, "{s} {", type_info->name then type_info->name otherwise "auto");
 		for (size_t i=0; i<st->len; i += 1) {
 			struct haste_struct_field field = st->items[i];
-			struct haste_value field_value = so->fields[i];
+			struct haste_value field_value = struct_object_get(so, st, i);
 			printed_amount += sprint(stream, "{s}: {value},", field.name, field_value);
 		}
 		printed_amount += sprint(stream, "}");
@@ -761,7 +962,7 @@ int print_value(stream_t stream, const struct haste_value value)
 		if (value_is_any_float(value))
 			printed_amount += sprint(stream, "{lf}", value.floating);
 		else
-			printed_amount += sprint(stream, "{i64}", value.integer);
+			printed_amount += print_haste_int(stream, value.integer, TYPE_FLAGS(value.type_id) & TYPE_FLAG_UNSIGNED);
 		break;
 	case HASTE_VL_RUNTIME:
 		printed_amount += print_haste_ast(stream, value.runtime);
@@ -0,0 +1,966 @@
+#include "haste.h"
+#include "my_allocator.h"
+#include "my_common.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// ── Compiler ─────────────────────────────────────────────────────
+
+struct vm_local {
+	const char *name;
+	uint32_t reg;
+	TypeID type;
+};
+
+struct vm_compiler {
+	struct vm *vm;
+	struct vm_chunk *chunk;
+	uint32_t top; // first free register
+
+	// params and locals of the function being compiled
+	struct { size_t cap, len; struct vm_local *items; } locals;
+	bool in_function;
+	TypeID return_type;
+};
+
+// `0` is analyzed to a ZERO value. it only becomes a number when something
+// uses it, so its register keeps the zero type until then.
+static bool is_zero_type(TypeID id)
+{
+	return id == AS_TYPEID(ty_zero);
+}
+
+static bool is_number_type(TypeID id)
+{
+	return TYPE_FLAGS(id) & (TYPE_FLAG_INTEGER | TYPE_FLAG_FLOAT);
+}
+
+static bool is_numeric_type(TypeID id)
+{
+	return is_zero_type(id) or is_number_type(id);
+}
+
+static bool is_float_type(TypeID id)
+{
+	return TYPE_FLAGS(id) & TYPE_FLAG_FLOAT;
+}
+
+static bool is_untyped_type(TypeID id)
+{
+	return TYPE_FLAGS(id) & TYPE_FLAG_UNTYPED;
+}
+
+// the one integer type whose values don't fit in a signed register. its
+// arithmetic is left to the tree walker
+static bool is_uint128_type(TypeID id)
+{
+	const uint8_t flags = TYPE_FLAGS(id);
+	return (flags & TYPE_FLAG_INTEGER) and (flags & TYPE_FLAG_UNSIGNED) and TYPE_INT_BITS(id) == 128;
+}
+
+static uint32_t reserve_register(struct vm_compiler *c)
+{
+	uint32_t reg = c->top++;
+	if (c->top > c->chunk->reg_count) {
+		c->chunk->reg_count = c->top;
+	}
+	return reg;
+}
+
+static void emit(struct vm_compiler *c, enum vm_op op, uint32_t dst, uint32_t a, uint32_t b, struct location loc)
+{
+	struct Allocator allocator = c->vm->allocator;
+	arrpush(allocator, c->chunk->code, ((struct vm_instr){ .op = op, .dst = dst, .a = a, .b = b }));
+	arrpush(allocator, c->chunk->locs, loc);
+}
+
+static bool load_value(struct vm_compiler *c, struct haste_value value, uint32_t dst, TypeID *type, struct location loc)
+{
+	if (IS_ZERO(value)) {
+		value = VAL_SCALAR(AS_TYPEID(ty_zero), .integer = 0);
+	} else if (not IS_SCALAR(value) or not is_number_type(value.type_id)) {
+		return false;
+	}
+
+	union vm_reg k = {0};
+	if (is_float_type(value.type_id)) {
+		k.floating = value.floating;
+	} else {
+		k.integer = value.integer;
+	}
+	arrpush(c->vm->allocator, c->chunk->constants, k);
+	emit(c, VM_LOADK, dst, (uint32_t)(c->chunk->constants.len - 1), 0, loc);
+	*type = value.type_id;
+	return true;
+}
+
+static struct vm_local *find_local(struct vm_compiler *c, const char *name)
+{
+	for (size_t i = c->locals.len; i > 0; i -= 1) {
+		if (strcmp(c->locals.items[i - 1].name, name) == 0) {
+			return &c->locals.items[i - 1];
+		}
+	}
+	return NULL;
+}
+
+// implicit conversion of r[reg], the way `value_coerce()` does it for numbers
+static bool emit_coerce(struct vm_compiler *c, uint32_t reg, TypeID *from, TypeID to, struct location loc)
+{
+	if (*from == to) return true;
+	if (not is_number_type(to) or is_untyped_type(to)) return false;
+
+	if (is_zero_type(*from) or (is_untyped_type(*from) and not is_float_type(*from))) {
+		const struct haste_type_info *info = type_pool_get(to);
+		if (info->is_float) {
+			emit(c, VM_INT_TO_FLOAT, reg, reg, 0, loc);
+		} else if (not is_zero_type(*from)) {
+			emit(c, VM_CHECK_RANGE, reg, int_type_bits(info), info->is_unsigned, loc);
+		}
+	} else if (not (is_untyped_type(*from) and is_float_type(to))) {
+		return false;
+	}
+
+	*from = to;
+	return true;
+}
+
+// truncates r[reg] to a typed integer narrower than the registers
+static void emit_wrap(struct vm_compiler *c, uint32_t reg, TypeID type, struct location loc)
+{
+	const struct haste_type_info *info = type_pool_get(type);
+	if (info->is_untyped or int_type_bits(info) >= 128) return;
+	emit(c, VM_WRAP_INT, reg, int_type_bits(info), info->is_unsigned, loc);
+}
+
+// explicit conversion of r[reg], the way `value_cast()` does it for numbers
+static bool emit_cast(struct vm_compiler *c, uint32_t reg, TypeID *from, struct haste_type to, struct location loc)
+{
+	if (type_equal(to, ty_auto) or *from == AS_TYPEID(to)) return true;
+	if (not type_is_number(to) or type_is_untyped(to)) return false;
+	if (not is_numeric_type(*from)) return false;
+
+	const bool from_float = is_float_type(*from);
+	if (not from_float and not is_zero_type(*from) and is_uint128_type(*from)) return false;
+
+	if (from_float and not type_is_float(to)) {
+		emit(c, VM_FLOAT_TO_INT, reg, reg, 0, loc);
+	} else if (not from_float and type_is_float(to)) {
+		emit(c, VM_INT_TO_FLOAT, reg, reg, 0, loc);
+	}
+	if (type_is_integer(to)) {
+		emit_wrap(c, reg, AS_TYPEID(to), loc);
+	}
+
+	*from = AS_TYPEID(to);
+	return true;
+}
+
+static bool compile_node(struct vm_compiler *c, struct haste_ast_node *node, uint32_t dst, TypeID *type);
+
+static bool compile_binary(struct vm_compiler *c, struct haste_ast_binary *node, uint32_t dst, TypeID *type)
+{
+	TypeID lt, rt;
+	if (not compile_node(c, node->lhs, dst, &lt)) return false;
+	const uint32_t tmp = reserve_register(c);
+	if (not compile_node(c, node->rhs, tmp, &rt)) return false;
+	c->top = tmp;
+
+	// same rules as `value_do_arith()`
+	if (is_zero_type(lt)) lt = AS_TYPEID(ty_untyped_int);
+	if (is_zero_type(rt)) rt = AS_TYPEID(ty_untyped_int);
+	if (not is_number_type(lt) or not is_number_type(rt)) return false;
+	if (not is_untyped_type(lt) and not is_untyped_type(rt) and lt != rt) return false;
+
+	const bool lhs_float = is_float_type(lt);
+	const bool rhs_float = is_float_type(rt);
+	const bool is_float = lhs_float or rhs_float;
+	enum vm_op op;
+	switch (node->op) {
+	case TK_PLUS:   op = is_float then VM_ADD_FLOAT otherwise VM_ADD_INT; break;
+	case TK_MINUS:  op = is_float then VM_SUB_FLOAT otherwise VM_SUB_INT; break;
+	case TK_STAR:   op = is_float then VM_MUL_FLOAT otherwise VM_MUL_INT; break;
+	case TK_FSLASH: op = is_float then VM_DIV_FLOAT otherwise VM_DIV_INT; break;
+	default: return false;
+	}
+
+	if (is_float) {
+		if (not lhs_float) emit(c, VM_INT_TO_FLOAT, dst, dst, 0, node->op_loc);
+		if (not rhs_float) emit(c, VM_INT_TO_FLOAT, tmp, tmp, 0, node->op_loc);
+		*type = (lhs_float or is_untyped_type(rt))
+			then AS_TYPEID(ty_float)
+			otherwise AS_TYPEID(ty_untyped_float);
+	} else {
+		*type = lt == rt then lt otherwise AS_TYPEID(ty_untyped_int);
+		if (is_uint128_type(*type)) return false;
+	}
+
+	emit(c, op, dst, dst, tmp, node->op_loc);
+	const struct haste_type_info *info = type_pool_get(*type);
+	if (not is_float and not info->is_untyped and (int_type_bits(info) < 128 or info->is_unsigned)) {
+		emit(c, VM_CHECK_OVERFLOW, dst, int_type_bits(info), info->is_unsigned, node->op_loc);
+	}
+	return true;
+}
+
+static bool compile_unary(struct vm_compiler *c, struct haste_ast_unary *node, uint32_t dst, TypeID *type)
+{
+	if (not compile_node(c, node->rhs, dst, type)) return false;
+
+	switch (node->op) {
+	case TK_PLUS: return true;
+	case TK_MINUS:
+		// negating ZERO keeps the zero type. leave that to the tree walker
+		if (is_zero_type(*type)) return false;
+		if (is_float_type(*type)) {
+			emit(c, VM_NEG_FLOAT, dst, dst, 0, node->op_loc);
+		} else if (TYPE_FLAGS(*type) & TYPE_FLAG_INTEGER) {
+			emit(c, VM_NEG_INT, dst, dst, 0, node->op_loc);
+			emit_wrap(c, dst, *type, node->op_loc);
+		} else {
+			return false;
+		}
+		return true;
+	default: return false;
+	}
+}
+
+static bool compile_cast(struct vm_compiler *c, struct haste_ast_cast *node, uint32_t dst, TypeID *type)
+{
+	struct haste_type to = {0};
+	if (node->to != NULL) {
+		if (not c->vm->resolver.type_of(c->vm->resolver.ctx, node->to, &to)) return false;
+	} else if (c->in_function and IS_TYPE(node->base.type.value)) {
+		// the implicit casts analysis inserts into function bodies
+		to = node->base.type;
+	} else {
+		return false;
+	}
+
+	if (not compile_node(c, node->expr, dst, type)) return false;
+	return emit_cast(c, dst, type, to, node->base.location);
+}
+
+static bool compile_ident(struct vm_compiler *c, struct haste_ast_ident *node, uint32_t dst, TypeID *type)
+{
+	if (c->in_function) {
+		// anything comptime-known from outside was injected while
+		// analyzing the body. so the rest has to be a param or a local
+		struct vm_local *local = find_local(c, node->value.chars);
+		if (local == NULL) return false;
+		emit(c, VM_MOVE, dst, local->reg, 0, node->base.location);
+		*type = local->type;
+		return true;
+	}
+
+	struct haste_value value;
+	if (not c->vm->resolver.lookup(c->vm->resolver.ctx, node, &value)) return false;
+	return load_value(c, value, dst, type, node->base.location);
+}
+
+static bool compile_call(struct vm_compiler *c, struct haste_ast_func_call *node, uint32_t dst, TypeID *type)
+{
+	if (c->vm->resolver.function_of == NULL) return false;
+	if (c->in_function and node->callee->kind == ND_IDENT
+	    and find_local(c, ((struct haste_ast_ident*)node->callee)->value.chars) != NULL) return false;
+
+	const struct haste_ast_func_decl *decl = c->vm->resolver.function_of(c->vm->resolver.ctx, node->callee, c->in_function);
+	if (decl == NULL) return false;
+	struct vm_function *fn = vm_compile_function(c->vm, decl);
+	if (fn == NULL) return false;
+
+	size_t argc = 0;
+	leach (struct haste_ast_func_call_arg, arg, node->args) {
+		argc += 1;
+	}
+	if (argc != fn->param_count or argc > UINT8_MAX) return false;
+
+	const uint32_t base = c->top;
+	size_t i = 0;
+	leach (struct haste_ast_func_call_arg, arg, node->args) {
+		const uint32_t reg = reserve_register(c);
+		TypeID arg_type;
+		if (not compile_node(c, arg->value, reg, &arg_type)) return false;
+		if (not emit_coerce(c, reg, &arg_type, fn->param_types[i], arg->value->location)) return false;
+		i += 1;
+	}
+	c->top = base;
+
+	size_t callee = c->chunk->callees.len;
+	iarreach (j, c->chunk->callees) {
+		if (c->chunk->callees.items[j] == fn) {
+			callee = j;
+			break;
+		}
+	}
+	if (callee == c->chunk->callees.len) {
+		arrpush(c->vm->allocator, c->chunk->callees, fn);
+	}
+
+	emit(c, VM_CALL, dst, (uint32_t)callee, base, node->base.location);
+	c->chunk->code.items[c->chunk->code.len - 1].argc = (uint8_t)argc;
+	*type = fn->return_type;
+	return true;
+}
+
+static bool compile_return(struct vm_compiler *c, struct haste_ast_node *value, struct location loc);
+static bool compile_local(struct vm_compiler *c, struct haste_ast_var_decl *node);
+
+// a branch of an `if`. its value goes to r[dst] as `result`, or nowhere
+// when the `if` is a statement (`result` is void)
+static bool compile_branch(struct vm_compiler *c, struct haste_ast_node *branch, uint32_t dst, TypeID result)
+{
+	const bool has_value = result != AS_TYPEID(ty_void);
+	TypeID type;
+	if (branch->kind != ND_BLOCK) {
+		if (not compile_node(c, branch, dst, &type)) return false;
+		return not has_value or emit_coerce(c, dst, &type, result, branch->location);
+	}
+
+	const size_t locals_len = c->locals.len;
+	const uint32_t top = c->top;
+	bool ok = not has_value; // a void branch can be empty
+	leach (struct haste_ast_node, stmt, ((struct haste_ast_block*)branch)->stmts) {
+		ok = false;
+		if (stmt->kind == ND_VAR_DECL) {
+			if (not compile_local(c, (void*)stmt)) break;
+			ok = not has_value or stmt->next != NULL;
+		} else if (stmt->kind == ND_RETURN) {
+			struct haste_ast_return *ret = (void*)stmt;
+			// whatever follows is dead
+			ok = ret->value != NULL and compile_return(c, ret->value, stmt->location);
+			break;
+		} else if (stmt->next == NULL) {
+			ok = compile_node(c, stmt, dst, &type)
+				and (not has_value or emit_coerce(c, dst, &type, result, stmt->location));
+		} else if (stmt->kind != ND_VALUE) { // could be a folded `return`
+			const uint32_t reg = reserve_register(c);
+			ok = compile_node(c, stmt, reg, &type);
+			c->top = reg;
+		}
+		if (not ok) break;
+	}
+	c->locals.len = locals_len;
+	c->top = top;
+	return ok;
+}
+
+// only in function bodies, where the analyzer already gave the `if` its
+// type. a condition it decided has one branch, the other was never analyzed
+static bool compile_if(struct vm_compiler *c, struct haste_ast_if *node, uint32_t dst, TypeID *type)
+{
+	if (not c->in_function or not IS_TYPE(node->base.type.value)) return false;
+	const TypeID result = AS_TYPEID(node->base.type);
+	if (result != AS_TYPEID(ty_void) and not is_number_type(result)) return false;
+	*type = result;
+
+	if (node->cond->kind == ND_VALUE) {
+		const struct haste_value cond = ((struct haste_ast_value*)node->cond)->value;
+		struct haste_ast_node *taken = not IS_ZERO(cond) and cond.integer != 0
+			then node->then_branch
+			otherwise node->else_branch;
+		return taken == NULL or compile_branch(c, taken, dst, result);
+	}
+
+	const uint32_t cond = reserve_register(c);
+	TypeID cond_type;
+	if (not compile_node(c, node->cond, cond, &cond_type) or is_float_type(cond_type)) return false;
+	c->top = cond;
+
+	const size_t to_else = c->chunk->code.len;
+	emit(c, VM_JUMP_IF_ZERO, cond, 0, 0, node->cond->location);
+	if (not compile_branch(c, node->then_branch, dst, result)) return false;
+	const size_t to_end = c->chunk->code.len;
+	emit(c, VM_JUMP, 0, 0, 0, node->base.location);
+
+	c->chunk->code.items[to_else].a = (uint32_t)c->chunk->code.len;
+	if (node->else_branch != NULL and not compile_branch(c, node->else_branch, dst, result)) return false;
+	c->chunk->code.items[to_end].a = (uint32_t)c->chunk->code.len;
+	return true;
+}
+
+static bool compile_node(struct vm_compiler *c, struct haste_ast_node *node, uint32_t dst, TypeID *type)
+{
+	if (node->kind == ND_VALUE) {
+		return load_value(c, ((struct haste_ast_value*)node)->value, dst, type, node->location);
+	}
+	// analyzed nodes outside of function bodies already failed once
+	if (node->analyzed and not c->in_function) return false;
+
+	switch (node->kind) {
+	case ND_INTEGER_LIT: {
+		const haste_int value = ((struct haste_ast_integer_lit*)node)->value;
+		return load_value(c,
+			value == 0 then VAL_ZERO otherwise VAL_SCALAR(AS_TYPEID(ty_untyped_int), .integer = value),
+			dst, type, node->location);
+	}
+	case ND_FLOAT_LIT:
+		return load_value(c,
+			VAL_SCALAR(AS_TYPEID(ty_untyped_float), .floating = ((struct haste_ast_float_lit*)node)->value),
+			dst, type, node->location);
+	case ND_IDENT:     return compile_ident (c, (void*)node, dst, type);
+	case ND_GROUPING:  return compile_node  (c, ((struct haste_ast_grouping*)node)->child, dst, type);
+	case ND_BINARY:    return compile_binary(c, (void*)node, dst, type);
+	case ND_UNARY:     return compile_unary (c, (void*)node, dst, type);
+	case ND_CAST:      return compile_cast  (c, (void*)node, dst, type);
+	case ND_FUNC_CALL: return compile_call  (c, (void*)node, dst, type);
+	case ND_IF:        return compile_if    (c, (void*)node, dst, type);
+	default:           return false;
+	}
+}
+
+static bool compile_return(struct vm_compiler *c, struct haste_ast_node *value, struct location loc)
+{
+	const uint32_t reg = reserve_register(c);
+	TypeID type;
+	if (not compile_node(c, value, reg, &type)) return false;
+	if (not emit_coerce(c, reg, &type, c->return_type, loc)) return false;
+	emit(c, VM_RET, 0, reg, 0, loc);
+	c->top = reg;
+	return true;
+}
+
+static bool compile_local(struct vm_compiler *c, struct haste_ast_var_decl *node)
+{
+	if (node->value == NULL or not IS_TYPE(node->base.type.value)) return false;
+
+	const uint32_t reg = reserve_register(c);
+	TypeID type;
+	if (not compile_node(c, node->value, reg, &type)) return false;
+	if (not emit_coerce(c, reg, &type, AS_TYPEID(node->base.type), node->name_loc)) return false;
+
+	arrpush(c->vm->allocator, c->locals, ((struct vm_local){
+		.name = node->name.chars,
+		.reg = reg,
+		.type = type,
+	}));
+	return true;
+}
+
+// a body is a single expression or a `do ... end` block of local
+// declarations, expression statements and returns.
+static bool compile_body(struct vm_compiler *c, struct haste_ast_node *body)
+{
+	if (body->kind != ND_BLOCK) {
+		return compile_return(c, body, body->location);
+	}
+
+	leach (struct haste_ast_node, stmt, ((struct haste_ast_block*)body)->stmts) {
+		switch (stmt->kind) {
+		case ND_VAR_DECL:
+			if (not compile_local(c, (void*)stmt)) return false;
+			break;
+		case ND_RETURN: {
+			struct haste_ast_return *ret = (void*)stmt;
+			if (ret->value == NULL) return false;
+			return compile_return(c, ret->value, stmt->location);
+		}
+		default:
+			if (stmt->next == NULL) {
+				return compile_return(c, stmt, stmt->location);
+			} else if (stmt->kind == ND_VALUE) {
+				// could be a `return` that got folded. can't tell
+				return false;
+			} else {
+				const uint32_t reg = reserve_register(c);
+				TypeID type;
+				if (not compile_node(c, stmt, reg, &type)) return false;
+				c->top = reg;
+			}
+			break;
+		}
+	}
+
+	// falls off the end without a value
+	return false;
+}
+
+static void chunk_free(struct Allocator allocator, struct vm_chunk *chunk)
+{
+	arrfree(allocator, chunk->code);
+	arrfree(allocator, chunk->locs);
+	arrfree(allocator, chunk->constants);
+	arrfree(allocator, chunk->callees);
+	*chunk = (struct vm_chunk){0};
+}
+
+static bool read_type_node(const struct haste_ast_node *node, TypeID *out)
+{
+	if (node == NULL or node->kind != ND_VALUE) return false;
+	const struct haste_value value = ((const struct haste_ast_value*)node)->value;
+	if (not IS_TYPE(value)) return false;
+	*out = AS_TYPEID(into_type(value));
+	return true;
+}
+
+static bool compile_function(struct vm *vm, struct vm_function *fn)
+{
+	const struct haste_ast_func_decl *decl = fn->decl;
+	if (decl->body == NULL or not IS_TYPE(decl->base.type.value)) return false;
+	fn->return_type = AS_TYPEID(decl->base.type);
+	if (not is_number_type(fn->return_type)) return false;
+
+	leach (struct haste_ast_func_param, param, decl->params) {
+		fn->param_count += param->name_count;
+	}
+	fn->param_types = alloc(vm->allocator, sizeof(TypeID) * SAFE_COUNT(fn->param_count));
+
+	struct vm_compiler c = {
+		.vm = vm,
+		.chunk = &fn->chunk,
+		.in_function = true,
+		.return_type = fn->return_type,
+	};
+
+	bool ok = true;
+	leach (struct haste_ast_func_param, param, decl->params) {
+		TypeID type;
+		if (not read_type_node(param->type, &type) or not is_number_type(type)) {
+			ok = false;
+			break;
+		}
+		for (size_t i = 0; i < param->name_count; i += 1) {
+			fn->param_types[c.top] = type;
+			arrpush(vm->allocator, c.locals, ((struct vm_local){
+				.name = param->names[i].chars,
+				.reg = c.top,
+				.type = type,
+			}));
+			reserve_register(&c);
+		}
+	}
+
+	ok = ok and compile_body(&c, decl->body);
+	arrfree(vm->allocator, c.locals);
+	return ok;
+}
+
+struct vm_function *vm_compile_function(struct vm *vm, const struct haste_ast_func_decl *decl)
+{
+	iarreach (i, vm->functions) {
+		struct vm_function *fn = vm->functions.items[i];
+		if (fn->decl == decl) {
+			return fn->state == VM_FN_UNSUPPORTED then NULL otherwise fn;
+		}
+	}
+
+	struct vm_function *fn = create(vm->allocator, struct vm_function,
+		.decl = decl,
+		.state = VM_FN_COMPILING);
+	arrpush(vm->allocator, vm->functions, fn);
+
+	if (compile_function(vm, fn)) {
+		fn->state = VM_FN_READY;
+		return fn;
+	}
+
+	fn->state = VM_FN_UNSUPPORTED;
+	chunk_free(vm->allocator, &fn->chunk);
+	return NULL;
+}
+
+// ── Memo ─────────────────────────────────────────────────────────
+
+#define MEMO_INITIAL_CAP 64
+
+// a float only uses the low 8 bytes of its register, the rest is whatever
+// was there before. so only the bits of the active member count
+static bool memo_args_equal(const struct vm_function *fn, const union vm_reg *a, const union vm_reg *b)
+{
+	for (size_t i = 0; i < fn->param_count; i += 1) {
+		if (is_float_type(fn->param_types[i])) {
+			if (memcmp(&a[i].floating, &b[i].floating, sizeof(double)) != 0) return false;
+		} else if (a[i].integer != b[i].integer) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static uint64_t memo_hash(const struct vm_function *fn, const union vm_reg *args)
+{
+	uint64_t h = 1469598103934665603ULL ^ (uint64_t)(uintptr_t)fn;
+	for (size_t i = 0; i < fn->param_count; i += 1) {
+		uint64_t bits;
+		memcpy(&bits, &args[i], sizeof(bits));
+		if (not is_float_type(fn->param_types[i])) {
+			bits ^= (uint64_t)((haste_uint)args[i].integer >> 64) * 0x9E3779B97F4A7C15ULL;
+		}
+		h = (h ^ bits) * 1099511628211ULL;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+static struct vm_memo_entry *memo_slot(const struct vm_memo *memo, const struct vm_function *fn, const union vm_reg *args, uint64_t hash)
+{
+	const size_t mask = memo->cap - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		struct vm_memo_entry *entry = &memo->items[i];
+		if (entry->fn == NULL) return entry;
+		if (entry->fn == fn and entry->hash == hash
+		    and memo_args_equal(fn, &memo->args.items[entry->args], args)) {
+			return entry;
+		}
+	}
+}
+
+static const struct vm_memo_entry *memo_find(struct vm *vm, const struct vm_function *fn, const union vm_reg *args, uint64_t hash)
+{
+	const struct vm_memo_entry *entry = vm->memo.len == 0 then NULL otherwise memo_slot(&vm->memo, fn, args, hash);
+	if (entry == NULL or entry->fn == NULL) {
+		vm->memo.misses += 1;
+		return NULL;
+	}
+	vm->memo.hits += 1;
+	return entry;
+}
+
+static void memo_grow(struct vm *vm)
+{
+	struct vm_memo old = vm->memo;
+	vm->memo.cap = old.cap == 0 then MEMO_INITIAL_CAP otherwise old.cap * 2;
+	vm->memo.items = alloc(vm->allocator, sizeof(struct vm_memo_entry) * vm->memo.cap);
+	memset(vm->memo.items, 0, sizeof(struct vm_memo_entry) * vm->memo.cap);
+
+	for (size_t i = 0; i < old.cap; i += 1) {
+		if (old.items[i].fn == NULL) continue;
+		const size_t mask = vm->memo.cap - 1;
+		size_t j = old.items[i].hash & mask;
+		while (vm->memo.items[j].fn != NULL) j = (j + 1) & mask;
+		vm->memo.items[j] = old.items[i];
+	}
+	if (old.items != NULL) {
+		xdestroy(vm->allocator, sizeof(struct vm_memo_entry) * old.cap, old.items);
+	}
+}
+
+// `args` can point into `vm->registers`. so they're copied before anything grows
+static void memo_insert(struct vm *vm, const struct vm_function *fn, const union vm_reg *args, uint64_t hash, union vm_reg result)
+{
+	const size_t at = vm->memo.args.len;
+	for (size_t i = 0; i < fn->param_count; i += 1) {
+		arrpush(vm->allocator, vm->memo.args, args[i]);
+	}
+
+	if ((vm->memo.len + 1) * 4 > vm->memo.cap * 3) {
+		memo_grow(vm);
+	}
+	struct vm_memo_entry *entry = memo_slot(&vm->memo, fn, &vm->memo.args.items[at], hash);
+	if (entry->fn != NULL) {
+		vm->memo.args.len = at;
+		return;
+	}
+	*entry = (struct vm_memo_entry){
+		.fn = fn,
+		.hash = hash,
+		.args = at,
+		.result = result,
+	};
+	vm->memo.len += 1;
+}
+
+// ── Interpreter ──────────────────────────────────────────────────
+
+static void push_frame(struct vm *vm, const struct vm_chunk *chunk, const struct vm_function *fn, uint64_t args_hash, uint32_t ret)
+{
+	const size_t base = vm->registers.len;
+	while (vm->registers.cap < base + chunk->reg_count) {
+		arrgrow(vm->allocator, vm->registers);
+	}
+	vm->registers.len = base + chunk->reg_count;
+	arrpush(vm->allocator, vm->frames, ((struct vm_frame){
+		.chunk = chunk,
+		.fn = fn,
+		.args_hash = args_hash,
+		.pc = 0,
+		.base = base,
+		.ret = ret,
+	}));
+}
+
+static enum token_kind op_token(enum vm_op op)
+{
+	switch (op) {
+	case VM_ADD_INT: case VM_ADD_FLOAT: return TK_PLUS;
+	case VM_SUB_INT: case VM_SUB_FLOAT: return TK_MINUS;
+	case VM_MUL_INT: case VM_MUL_FLOAT: return TK_STAR;
+	case VM_DIV_INT: case VM_DIV_FLOAT: return TK_FSLASH;
+	case VM_NEG_INT: case VM_NEG_FLOAT: return TK_MINUS;
+	case VM_CALL: return TK_OPEN_PAREN;
+	default: return TK_EOF;
+	}
+}
+
+// the call instruction of every caller frame, innermost first. frames
+// called from a site already listed only bump its count
+static void collect_trace(const struct vm *vm, struct vm_error *err)
+{
+	err->trace_len = 0;
+	for (size_t i = vm->frames.len - 1; i > 0; i -= 1) {
+		const struct vm_frame *caller = &vm->frames.items[i - 1];
+		const struct location loc = caller->chunk->locs.items[caller->pc - 1];
+
+		uint32_t j = 0;
+		while (j < err->trace_len and (err->trace[j].src != loc.src or err->trace[j].start != loc.start)) j += 1;
+		if (j < err->trace_len) {
+			err->trace_calls[j] += 1;
+		} else if (err->trace_len < VM_MAX_TRACE) {
+			err->trace[err->trace_len] = loc;
+			err->trace_calls[err->trace_len] = 1;
+			err->trace_len += 1;
+		}
+	}
+}
+
+uint64_t vm_now_ns(void)
+{
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+#define vm_raise(code_) vm_raise_at(code_, op_token(in.op))
+#define vm_raise_at(code_, op_) \
+	do { \
+		*err = (struct vm_error){ \
+			.code = (code_), \
+			.op = (op_), \
+			.loc = frame->chunk->locs.items[frame->pc - 1], \
+		}; \
+		if ((code_) == ERR_COMPTIME_STEPS or (code_) == ERR_COMPTIME_TIME) collect_trace(vm, err); \
+		vm->frames.len = 0; \
+		vm->registers.len = 0; \
+		return VM_FAILED; \
+	} while (0)
+
+static enum vm_status execute(
+	struct vm *vm,
+	const struct vm_chunk *entry,
+	const struct vm_function *fn,
+	uint64_t args_hash,
+	const union vm_reg *args,
+	size_t argc,
+	union vm_reg *result,
+	struct vm_error *err)
+{
+	vm->frames.len = 0;
+	vm->registers.len = 0;
+	push_frame(vm, entry, fn, args_hash, 0);
+	if (argc > 0) {
+		memcpy(vm->registers.items, args, sizeof(union vm_reg) * argc);
+	}
+
+	for (;;) {
+		struct vm_frame *frame = &vm->frames.items[vm->frames.len - 1];
+		const struct vm_instr in = frame->chunk->code.items[frame->pc++];
+		const union vm_reg *k = frame->chunk->constants.items;
+		union vm_reg *r = vm->registers.items + frame->base;
+
+		if (++vm->steps > vm->step_limit) vm_raise(ERR_COMPTIME_STEPS);
+		if ((vm->steps & 0xffff) == 0 and vm->deadline_ns != 0 and vm_now_ns() > vm->deadline_ns) {
+			vm_raise(ERR_COMPTIME_TIME);
+		}
+
+		switch (in.op) {
+		case VM_LOADK: r[in.dst] = k[in.a]; break;
+		case VM_MOVE:  r[in.dst] = r[in.a]; break;
+
+		case VM_ADD_INT:
+			if (__builtin_add_overflow(r[in.a].integer, r[in.b].integer, &r[in.dst].integer))
+				vm_raise(ERR_ARITH_OVERFLOW);
+			break;
+		case VM_SUB_INT:
+			if (__builtin_sub_overflow(r[in.a].integer, r[in.b].integer, &r[in.dst].integer))
+				vm_raise(ERR_ARITH_OVERFLOW);
+			break;
+		case VM_MUL_INT:
+			if (__builtin_mul_overflow(r[in.a].integer, r[in.b].integer, &r[in.dst].integer))
+				vm_raise(ERR_ARITH_OVERFLOW);
+			break;
+		case VM_DIV_INT:
+			if (r[in.b].integer == 0) vm_raise(ERR_DIVISION_BY_ZERO);
+			if (r[in.a].integer == HASTE_INT_MIN and r[in.b].integer == -1) vm_raise(ERR_ARITH_OVERFLOW);
+			r[in.dst].integer = r[in.a].integer / r[in.b].integer;
+			break;
+
+		case VM_ADD_FLOAT: r[in.dst].floating = r[in.a].floating + r[in.b].floating; break;
+		case VM_SUB_FLOAT: r[in.dst].floating = r[in.a].floating - r[in.b].floating; break;
+		case VM_MUL_FLOAT: r[in.dst].floating = r[in.a].floating * r[in.b].floating; break;
+		case VM_DIV_FLOAT:
+			if (r[in.b].floating == 0.0) vm_raise(ERR_DIVISION_BY_ZERO);
+			r[in.dst].floating = r[in.a].floating / r[in.b].floating;
+			break;
+
+		// wraps instead of overflowing. just like the tree walker's negation
+		case VM_NEG_INT:   r[in.dst].integer = (haste_int)(0 - (haste_uint)r[in.a].integer); break;
+		case VM_NEG_FLOAT: r[in.dst].floating = -r[in.a].floating; break;
+
+		case VM_INT_TO_FLOAT: r[in.dst].floating = (double)r[in.a].integer; break;
+		case VM_FLOAT_TO_INT: r[in.dst].integer = (haste_int)r[in.a].floating; break;
+
+		// follows the arithmetic op it checks
+		case VM_CHECK_OVERFLOW:
+			if (not int_fits(r[in.dst].integer, (uint16_t)in.a, in.b != 0))
+				vm_raise_at(ERR_ARITH_OVERFLOW, op_token(frame->chunk->code.items[frame->pc - 2].op));
+			break;
+		case VM_CHECK_RANGE:
+			if (not int_fits(r[in.dst].integer, (uint16_t)in.a, in.b != 0))
+				vm_raise(ERR_INT_OUT_OF_RANGE);
+			break;
+		case VM_WRAP_INT: r[in.dst].integer = int_wrap(r[in.dst].integer, (uint16_t)in.a, in.b != 0); break;
+
+		case VM_CALL: {
+			const struct vm_function *fn = frame->chunk->callees.items[in.a];
+			if (fn->state != VM_FN_READY) {
+				// a function it calls failed to compile after this one was compiled
+				vm->frames.len = 0;
+				vm->registers.len = 0;
+				return VM_UNSUPPORTED;
+			}
+
+			const size_t args_at = frame->base + in.b;
+			const uint64_t hash = memo_hash(fn, &r[in.b]);
+			const struct vm_memo_entry *memo = memo_find(vm, fn, &r[in.b], hash);
+			if (memo != NULL) {
+				r[in.dst] = memo->result;
+				break;
+			}
+
+			if (vm->frames.len >= VM_MAX_CALL_DEPTH) vm_raise(ERR_CALL_DEPTH_EXCEEDED);
+			push_frame(vm, &fn->chunk, fn, hash, in.dst);
+			const size_t base = vm->frames.items[vm->frames.len - 1].base;
+			memmove(vm->registers.items + base, vm->registers.items + args_at, sizeof(union vm_reg) * in.argc);
+		} break;
+
+		case VM_JUMP: frame->pc = in.a; break;
+		case VM_JUMP_IF_ZERO:
+			if (r[in.dst].integer == 0) frame->pc = in.a;
+			break;
+
+		case VM_RET: {
+			const union vm_reg value = r[in.a];
+			const uint32_t ret = frame->ret;
+			if (frame->fn != NULL) {
+				// params are never written to. so r[0..] still holds the arguments
+				memo_insert(vm, frame->fn, r, frame->args_hash, value);
+			}
+			vm->registers.len = frame->base;
+			vm->frames.len -= 1;
+			if (vm->frames.len == 0) {
+				*result = value;
+				return VM_OK;
+			}
+			const struct vm_frame *caller = &vm->frames.items[vm->frames.len - 1];
+			vm->registers.items[caller->base + ret] = value;
+		} break;
+		}
+	}
+}
+
+#undef vm_raise
+#undef vm_raise_at
+
+static struct haste_value reg_into_value(union vm_reg reg, TypeID type)
+{
+	if (is_zero_type(type)) return VAL_ZERO;
+	if (is_float_type(type)) return VAL_SCALAR(type, .floating = reg.floating);
+	return VAL_SCALAR(type, .integer = reg.integer);
+}
+
+// ── Public API ───────────────────────────────────────────────────
+
+void vm_init(struct vm *vm, struct Allocator allocator, struct vm_resolver resolver)
+{
+	*vm = (struct vm){
+		.allocator = allocator,
+		.resolver = resolver,
+		.step_limit = UINT64_MAX,
+	};
+}
+
+void vm_deinit(struct vm *vm)
+{
+	iarreach (i, vm->functions) {
+		struct vm_function *fn = vm->functions.items[i];
+		chunk_free(vm->allocator, &fn->chunk);
+		if (fn->param_types != NULL) {
+			xdestroy(vm->allocator, sizeof(TypeID) * SAFE_COUNT(fn->param_count), fn->param_types);
+		}
+		xdestroy(vm->allocator, sizeof(*fn), fn);
+	}
+	chunk_free(vm->allocator, &vm->scratch);
+	if (vm->memo.items != NULL) {
+		xdestroy(vm->allocator, sizeof(struct vm_memo_entry) * vm->memo.cap, vm->memo.items);
+	}
+	arrfree(vm->allocator, vm->memo.args);
+	arrfree(vm->allocator, vm->functions);
+	arrfree(vm->allocator, vm->registers);
+	arrfree(vm->allocator, vm->frames);
+}
+
+enum vm_status vm_eval(struct vm *vm, struct haste_ast_node *expr, struct haste_value *out, struct vm_error *err)
+{
+	// resolving a name can analyze (and evaluate) another declaration
+	// while this one is being compiled. only the outermost gets the scratch
+	struct vm_chunk nested = {0};
+	const bool owns_scratch = not vm->scratch_in_use;
+	struct vm_chunk *chunk = owns_scratch then &vm->scratch otherwise &nested;
+	chunk->code.len = 0;
+	chunk->locs.len = 0;
+	chunk->constants.len = 0;
+	chunk->callees.len = 0;
+	chunk->reg_count = 0;
+	vm->scratch_in_use = true;
+
+	struct vm_compiler c = { .vm = vm, .chunk = chunk };
+
+	enum vm_status status = VM_UNSUPPORTED;
+	const uint32_t dst = reserve_register(&c);
+	TypeID type;
+	if (compile_node(&c, expr, dst, &type)) {
+		emit(&c, VM_RET, 0, dst, 0, expr->location);
+		union vm_reg result;
+		status = execute(vm, chunk, NULL, 0, NULL, 0, &result, err);
+		if (status == VM_OK) {
+			*out = reg_into_value(result, type);
+		}
+	}
+
+	if (owns_scratch) {
+		vm->scratch_in_use = false;
+	} else {
+		chunk_free(vm->allocator, &nested);
+	}
+	return status;
+}
+
+enum vm_status vm_call(struct vm *vm, struct vm_function *fn, const struct haste_value *args, struct haste_value *out, struct vm_error *err)
+{
+	assert(fn->state == VM_FN_READY);
+
+	union vm_reg regs[SAFE_COUNT(fn->param_count)];
+	for (size_t i = 0; i < fn->param_count; i += 1) {
+		if (is_float_type(fn->param_types[i])) {
+			regs[i].floating = args[i].floating;
+		} else {
+			regs[i].integer = args[i].integer;
+		}
+	}
+
+	union vm_reg result;
+	const uint64_t hash = memo_hash(fn, regs);
+	const struct vm_memo_entry *memo = memo_find(vm, fn, regs, hash);
+	if (memo != NULL) {
+		*out = reg_into_value(memo->result, fn->return_type);
+		return VM_OK;
+	}
+
+	const enum vm_status status = execute(vm, &fn->chunk, fn, hash, regs, fn->param_count, &result, err);
+	if (status == VM_OK) {
+		*out = reg_into_value(result, fn->return_type);
+	}
+	return status;
+}
@@ -1,5 +1,5 @@
 #!/usr/bin/env python3
-import os, subprocess, sys, glob, re
+import os, subprocess, sys, glob, re, shutil, difflib
 
 PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
 HASTE = os.path.join(PROJECT_DIR, "haste")
@@ -21,19 +21,45 @@ def _run_one_test(group, file_path, index=0, leng=0):
     name = os.path.splitext(os.path.basename(file_path))[0]
     group_dir = group["dir"]
     got_path = _test_path(group_dir, name, group["got_suffix"])
-    expected_path = _test_path(group_dir, name, group["expected_suffix"])
+    # groups checked against another build of the file have no expected file
+    expected_suffix = group.get("expected_suffix")
+    expected_path = expected_suffix and _test_path(group_dir, name, expected_suffix)
     kind = group["kind"]
     cmd = [HASTE, *group["flags"], file_path]
+    if group.get("edits"):
+        # `name.edit1.haste`, `name.edit2.haste`, ... in order, after the file
+        cmd += sorted(glob.glob(os.path.join(PROJECT_DIR, group_dir, f"{name}.edit*.haste")))
     skip = group.get("skip_lines", 0)
     expect_failure = group.get("expect_failure", False)
     file_output_ext = group.get("file_output")
 
+    jit_cache = group.get("jit_cache")
+    if jit_cache:
+        # a cold run fills the cache, the run that is checked must load from it
+        cache_dir = os.path.join(PROJECT_DIR, jit_cache)
+        shutil.rmtree(cache_dir, ignore_errors=True)
+        subprocess.run(cmd, capture_output=True, cwd=PROJECT_DIR)
+        cached = _cache_entries(cache_dir)
+
+    reference_flags = group.get("same_as")
+    reference_lines = None
+    if reference_flags:
+        # the expected module is whatever the default path makes of the file.
+        # it is only kept in memory, nothing is left next to the tests
+        subprocess.run([HASTE, *reference_flags, file_path], capture_output=True, cwd=PROJECT_DIR)
+        reference_path = os.path.splitext(file_path)[0] + file_output_ext
+        with open(reference_path, "rb") as f:
+            reference_lines = _canonical_module(f.read()).decode().splitlines(keepends=True)
+        os.remove(reference_path)  # the run under test has to write its own
+
     result = subprocess.run(cmd, capture_output=True, cwd=PROJECT_DIR)
 
     if file_output_ext:
         output_path = os.path.splitext(file_path)[0] + file_output_ext
         with open(output_path, "rb") as f:
             got_data = f.read()
+        if reference_flags:
+            got_data = _canonical_module(got_data)
     else:
         ansi_re = re.compile(rb'\033\[[0-9;]*[a-zA-Z]')
         def strip_ansi(data):
@@ -46,6 +72,11 @@ def _run_one_test(group, file_path, index=0, leng=0):
             if result.stderr:
                 got_data += result.stderr
 
+    if jit_cache:
+        got_data += b"exit status: %d\n" % result.returncode
+        reused = cached and _cache_entries(cache_dir) == cached
+        got_data += b"jit cache: reused\n" if reused else b"jit cache: rebuilt\n"
+
     with open(got_path, "wb") as f:
         f.write(got_data)
 
@@ -58,8 +89,11 @@ def _run_one_test(group, file_path, index=0, leng=0):
             red(f"{int((float(index) / float(leng)) * 100.0):3}% FAIL: {kind:>10}: {name} (compiler crash)")
             return {"name": name, "kind": kind, "passed": False}
 
-    with open(expected_path) as f:
-        expected_lines = f.readlines()[skip:]
+    if reference_lines is not None:
+        expected_lines = reference_lines[skip:]
+    else:
+        with open(expected_path) as f:
+            expected_lines = f.readlines()[skip:]
     with open(got_path) as f:
         got_lines = f.readlines()[skip:]
 
@@ -68,13 +102,67 @@ def _run_one_test(group, file_path, index=0, leng=0):
         return {"name": name, "kind": kind, "passed": True}
     else:
         red(f"{int((float(index) / float(leng)) * 100.0):3}% FAIL {kind:>10}: {name} (output mismatch)")
-        subprocess.run(["diff", "-u", expected_path, got_path])
+        if reference_lines is not None:
+            sys.stdout.writelines(difflib.unified_diff(expected_lines, got_lines, " ".join(reference_flags), got_path))
+        else:
+            subprocess.run(["diff", "-u", expected_path, got_path])
         return {"name": name, "kind": kind, "passed": False}
 
 
+def _canonical_module(data):
+    # the top-level entities of an .ll file, sorted. --pipeline and --jobs
+    # emit the same ones in another order (and --jobs links partitions, which
+    # renames what clashes), so the numbered names are replaced: string
+    # constants by their contents, struct types by their body. linking also
+    # merges struct types with the same body, so their names can't be kept
+    items, block = [], None
+    for line in data.decode().splitlines():
+        if block is not None:
+            block.append(line)
+            if line == "}":
+                items.append("\n".join(block))
+                block = None
+        elif line.startswith("define "):
+            block = [line]
+        elif line.strip() and not line.startswith(("; ModuleID", "source_filename")):
+            items.append(line)
+
+    names = {}
+    bodies = {}
+    for item in items:
+        m = re.match(r'(@\.str[.\d]*) = .* (?:c"(.*)"|zeroinitializer)$', item)
+        if m:
+            names[m.group(1)] = f'@.str<{m.group(2) or ""}>'
+        m = re.match(r'(%struct\.type\.[\w.]+) = type (.*)$', item)
+        if m:
+            bodies[m.group(1)] = m.group(2)
+
+    def struct_name(name):
+        if name not in names:
+            body = re.sub(r'%struct\.type\.[\w.]+', lambda m: struct_name(m.group(0)), bodies[name])
+            names[name] = f"%struct<{body}>"
+        return names[name]
+    for name in bodies:
+        struct_name(name)
+
+    rename = lambda m: names.get(m.group(0), m.group(0))
+    items = [re.sub(r'@\.str[.\d]*|%struct\.type\.[\w.]+', rename, item) for item in items]
+    return ("\n".join(sorted(set(items))) + "\n").encode()
+
+
+def _cache_entries(cache_dir):
+    # the inode changes when an entry is written again
+    if not os.path.isdir(cache_dir):
+        return None
+    return sorted((e.name, e.stat().st_ino) for e in os.scandir(cache_dir))
+
+
 def _discover_tests(group):
     pattern = os.path.join(PROJECT_DIR, group["dir"], group["pattern"])
-    return sorted(glob.glob(pattern))
+    files = sorted(glob.glob(pattern))
+    if group.get("edits"):
+        files = [f for f in files if ".edit" not in os.path.basename(f)]
+    return files
 
 
 # ── Configure test groups here ──────────────────────────────────
@@ -99,6 +187,26 @@ TEST_GROUPS = [
         "got_suffix": "err.got",
         "expect_failure": True,
     },
+    {
+        "name": "comptime steps",
+        "kind": "errors",
+        "dir": "test/errors/comptime_steps",
+        "pattern": "*.haste",
+        "flags": ["--no-fun", "--comptime-steps=1000"],
+        "expected_suffix": "err.expected",
+        "got_suffix": "err.got",
+        "expect_failure": True,
+    },
+    {
+        "name": "max errors",
+        "kind": "errors",
+        "dir": "test/errors/max_errors",
+        "pattern": "*.haste",
+        "flags": ["--no-fun", "--max-errors=2"],
+        "expected_suffix": "err.expected",
+        "got_suffix": "err.got",
+        "expect_failure": True,
+    },
     {
         "name": "integration",
         "kind": "llvm",
@@ -110,6 +218,46 @@ TEST_GROUPS = [
         "skip_lines": 2,
         "file_output": ".ll",
     },
+    {
+        "name": "pipeline",
+        "kind": "pipeline",
+        "dir": "test/integration",
+        "pattern": "*.haste",
+        "flags": ["--llvm", "--no-fun", "--pipeline"],
+        "same_as": ["--llvm", "--no-fun"],
+        "got_suffix": "pipeline.got",
+        "file_output": ".ll",
+    },
+    {
+        "name": "jobs",
+        "kind": "jobs",
+        "dir": "test/integration",
+        "pattern": "*.haste",
+        "flags": ["--llvm", "--no-fun", "--jobs=3"],
+        "same_as": ["--llvm", "--no-fun"],
+        "got_suffix": "jobs.got",
+        "file_output": ".ll",
+    },
+    {
+        "name": "incremental",
+        "kind": "reuse",
+        "dir": "test/incremental",
+        "pattern": "*.haste",
+        "flags": ["--incremental", "--no-fun"],
+        "expected_suffix": "expected",
+        "got_suffix": "got",
+        "edits": True,
+    },
+    {
+        "name": "run",
+        "kind": "run",
+        "dir": "test/run",
+        "pattern": "*.haste",
+        "flags": ["run", "--no-fun", "--jit-cache=.build/jit-cache"],
+        "expected_suffix": "expected",
+        "got_suffix": "got",
+        "jit_cache": ".build/jit-cache",
+    },
 ]
 # ────────────────────────────────────────────────────────────────
 